@@ -0,0 +1,73 @@
+"""
+Measures how long it takes to copy each decoded attribute out of
+Draco into a NumPy array, per attribute type and data type.
+
+Runs on testdata_files/bunny.drc and on synthetic grid meshes with
+several million vertices carrying one attribute of each supported
+data type, encoded both with edgebreaker (default) and with
+preserve_order=True (sequential encoding).
+
+Usage: python benchmarks/decode_kernels.py [num_vertices ...]
+"""
+import os
+import sys
+
+import numpy as np
+import DracoPy
+
+testdata_directory = os.path.join(os.path.dirname(__file__), "..", "testdata_files")
+
+def grid_mesh(num_vertices):
+  side = max(int(np.sqrt(num_vertices)), 2)
+  y, x = np.mgrid[0:side, 0:side]
+  points = np.zeros((side * side, 3), dtype=np.float32)
+  points[:,0] = x.ravel()
+  points[:,1] = y.ravel()
+  points[:,2] = np.sin(x.ravel() / 10.0) * np.cos(y.ravel() / 10.0)
+
+  idx = np.arange(side * side, dtype=np.uint32).reshape((side, side))
+  a = idx[:-1,:-1].ravel()
+  b = idx[:-1,1:].ravel()
+  c = idx[1:,:-1].ravel()
+  d = idx[1:,1:].ravel()
+  faces = np.concatenate([
+    np.stack([a, b, d], axis=1),
+    np.stack([a, d, c], axis=1),
+  ])
+  return points, faces
+
+def synthetic_attributes(num_points):
+  rng = np.random.default_rng(0)
+  return {
+    "normals": rng.random((num_points, 3), dtype=np.float32),
+    "colors": rng.integers(0, 255, (num_points, 4), dtype=np.uint8),
+    "generic_attributes": {
+      "labels_u16": rng.integers(0, 2**16, (num_points, 1), dtype=np.uint16),
+      "labels_u32": rng.integers(0, 2**32, (num_points, 2), dtype=np.uint32),
+      "scalar_f32": rng.random((num_points, 1), dtype=np.float32),
+    },
+  }
+
+def report(title, binary, repeats):
+  print(f"\n{title} ({len(binary) / 1e6:.2f} MB encoded)")
+  print(f"{'attribute':<12} {'dtype':<12} {'comp':>4} {'points':>10} {'ms':>9} {'MB/s':>10}")
+  for att_type, data_type, num_components, num_points, seconds in DracoPy._benchmark_attribute_copies(binary, repeats):
+    dtype = np.dtype(DracoPy.NUMPY_DTYPES[data_type])
+    nbytes = num_points * num_components * dtype.itemsize
+    mbps = (nbytes / 1e6) / seconds if seconds > 0 else float('inf')
+    print(f"{att_type.name:<12} {data_type.name:<12} {num_components:>4} {num_points:>10} {seconds * 1e3:>9.3f} {mbps:>10.1f}")
+
+def main(sizes):
+  with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as f:
+    report("bunny.drc", f.read(), repeats=50)
+
+  for num_vertices in sizes:
+    points, faces = grid_mesh(num_vertices)
+    attributes = synthetic_attributes(len(points))
+    for preserve_order in (False, True):
+      binary = DracoPy.encode(points, faces, preserve_order=preserve_order, **attributes)
+      report(f"grid {len(points)} vertices, preserve_order={preserve_order}", binary, repeats=5)
+
+if __name__ == "__main__":
+  sizes = [ int(arg) for arg in sys.argv[1:] ] or [ 1_000_000, 4_000_000 ]
+  main(sizes)
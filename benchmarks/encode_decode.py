@@ -0,0 +1,140 @@
+"""
+Measures encode and decode throughput on synthetic meshes and point
+clouds, sweeping compression_level, quantization_bits and
+preserve_order, and breaks the time down per stage.
+
+Encode stages: marshal (validating and borrowing the NumPy inputs),
+build (draco geometry), draco (Draco's encoder) and copy (into bytes).
+Decode stages: header (geometry type sniff), draco (Draco's decoder),
+describe (attribute descriptions), faces and attributes (copies into
+NumPy) and wrap (building the returned object).
+
+Throughput is reported against the uncompressed size of the inputs.
+Stage timings come from the stats argument of encode() and decode().
+
+Usage: python benchmarks/encode_decode.py [--sizes 1000 100000 ...]
+  [--attributes positions full] [--levels 1 7] [--bits 11 14]
+  [--repeats 3] [--point-clouds] [--decode-threads 1] [--json results.json]
+"""
+import argparse
+import json
+import time
+
+import numpy as np
+import DracoPy
+
+from decode_kernels import grid_mesh, synthetic_attributes
+
+ENCODE_STAGES = [ "marshal", "build", "draco", "copy" ]
+DECODE_STAGES = [ "header", "draco", "describe", "faces", "attributes", "wrap" ]
+
+def attribute_set(name, num_points):
+  if name == "positions":
+    return {}
+  attributes = synthetic_attributes(num_points)
+  if name == "normals":
+    return { "normals": attributes["normals"] }
+  rng = np.random.default_rng(1)
+  attributes["tex_coord"] = rng.random((num_points, 2), dtype=np.float32)
+  return attributes
+
+def uncompressed_size(points, faces, attributes):
+  arrays = [ points, faces ] + [ v for k, v in attributes.items() if k != "generic_attributes" ]
+  arrays += list(attributes.get("generic_attributes", {}).values())
+  return sum(arr.nbytes for arr in arrays if arr is not None)
+
+def best_of(repeats, fn):
+  """Runs fn(stats) repeats times and keeps the stats of the fastest run."""
+  best = None
+  for _ in range(repeats):
+    stages = {}
+    start = time.perf_counter()
+    result = fn(stages)
+    total = time.perf_counter() - start
+    if best is None or total < best[1]:
+      best = (result, total, stages)
+  return best
+
+def run(points, faces, attributes, options, repeats, decode_threads):
+  binary, encode_seconds, encode_stages = best_of(
+    repeats, lambda stats: DracoPy.encode(points, faces, **attributes, **options, stats=stats)
+  )
+  _, decode_seconds, decode_stages = best_of(
+    repeats, lambda stats: DracoPy.decode(binary, stats=stats, threads=decode_threads)
+  )
+  return {
+    "encoded_bytes": len(binary),
+    "encode_seconds": encode_seconds,
+    "decode_seconds": decode_seconds,
+    "encode_stages": encode_stages,
+    "decode_stages": decode_stages,
+  }
+
+def header():
+  columns = f"{'kind':<6} {'vertices':>9} {'attrs':<9} {'lvl':>3} {'bits':>4} {'order':<5} {'ratio':>6}"
+  columns += f" {'enc MB/s':>9} {'enc Mv/s':>8} {'dec MB/s':>9} {'dec Mv/s':>8}"
+  print(columns)
+
+def report(row):
+  size = row["uncompressed_bytes"] / 1e6
+  vertices = row["vertices"] / 1e6
+  line = f"{row['kind']:<6} {row['vertices']:>9} {row['attributes']:<9} {row['compression_level']:>3}"
+  line += f" {row['quantization_bits']:>4} {str(row['preserve_order']):<5}"
+  line += f" {row['uncompressed_bytes'] / row['encoded_bytes']:>6.1f}"
+  line += f" {size / row['encode_seconds']:>9.1f} {vertices / row['encode_seconds']:>8.2f}"
+  line += f" {size / row['decode_seconds']:>9.1f} {vertices / row['decode_seconds']:>8.2f}"
+  print(line)
+  encode = "  ".join(f"{stage} {row['encode_stages'][stage] * 1e3:.2f}" for stage in ENCODE_STAGES)
+  decode = "  ".join(f"{stage} {row['decode_stages'][stage] * 1e3:.2f}" for stage in DECODE_STAGES)
+  print(f"    encode ms: {encode}")
+  print(f"    decode ms: {decode}")
+
+def main(args):
+  rows = []
+  kinds = [ "mesh", "points" ] if args.point_clouds else [ "mesh" ]
+  header()
+  for num_vertices in args.sizes:
+    points, faces = grid_mesh(num_vertices)
+    for attributes_name in args.attributes:
+      attributes = attribute_set(attributes_name, len(points))
+      for kind in kinds:
+        kind_faces = faces if kind == "mesh" else None
+        kind_attributes = attributes
+        if kind == "points":
+          # point clouds only carry colors and generic attributes
+          kind_attributes = { k: v for k, v in attributes.items() if k in ("colors", "generic_attributes") }
+        for level in args.levels:
+          for bits in args.bits:
+            for preserve_order in (False, True):
+              options = {
+                "compression_level": level,
+                "quantization_bits": bits,
+                "preserve_order": preserve_order,
+              }
+              row = run(points, kind_faces, kind_attributes, options, args.repeats, args.decode_threads)
+              row.update(options)
+              row.update({
+                "kind": kind,
+                "vertices": len(points),
+                "attributes": attributes_name,
+                "uncompressed_bytes": uncompressed_size(points, kind_faces, kind_attributes),
+              })
+              report(row)
+              rows.append(row)
+
+  if args.json:
+    with open(args.json, "w") as f:
+      json.dump(rows, f, indent=2)
+
+if __name__ == "__main__":
+  parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+  parser.add_argument("--sizes", type=int, nargs="+", default=[ 1_000, 100_000, 1_000_000 ])
+  parser.add_argument("--attributes", nargs="+", default=[ "positions", "full" ],
+    choices=[ "positions", "normals", "full" ])
+  parser.add_argument("--levels", type=int, nargs="+", default=[ 1, 7 ])
+  parser.add_argument("--bits", type=int, nargs="+", default=[ 11, 14 ])
+  parser.add_argument("--repeats", type=int, default=3)
+  parser.add_argument("--point-clouds", action="store_true", help="also encode the vertices as point clouds")
+  parser.add_argument("--decode-threads", type=int, default=1, help="threads copying decoded arrays out (0: one per core)")
+  parser.add_argument("--json", help="also write every result to this file")
+  main(parser.parse_args())
@@ -0,0 +1,44 @@
+// libFuzzer harness over DracoFunctions::decode_buffer, decoding with
+// limits set the way untrusted uploads should be decoded, then copying
+// everything out as DracoPy.decode(threads=2) would. Build and run with
+//
+//   make fuzz
+//   draco/build_fuzz/decode_fuzzer -rss_limit_mb=2048 -timeout=10 testdata_files
+
+#include <cstdint>
+#include <vector>
+
+#include "DracoPy.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  const char *buffer = reinterpret_cast<const char*>(data);
+
+  DracoFunctions::DecodeOptions options;
+  options.limits.max_points = 1 << 20;
+  options.limits.max_faces = 1 << 21;
+  options.limits.max_attributes = 16;
+  options.limits.max_output_bytes = 256 << 20;
+  if (size > 0 && data[0] & 1) {
+    options.bbox = { -1.0, -1.0, -1.0, 1.0, 1.0, 1.0 };
+  }
+
+  DracoFunctions::probe_buffer(buffer, size);
+
+  DracoFunctions::MeshObject mesh = DracoFunctions::decode_buffer(buffer, size, options);
+  if (mesh.decode_status != DracoFunctions::successful) {
+    return 0;
+  }
+
+  std::vector<uint32_t> faces(3 * static_cast<size_t>(mesh.num_faces));
+  std::vector<std::vector<uint8_t>> values(mesh.attributes.size());
+  std::vector<void*> outs;
+  for (size_t i = 0; i < mesh.attributes.size(); ++i) {
+    const DracoFunctions::AttributeData &attribute = mesh.attributes[i];
+    const int length = draco::DataTypeLength(static_cast<draco::DataType>(DracoFunctions::decoded_data_type(attribute.data_type)));
+    values[i].resize(static_cast<size_t>(mesh.num_points) * attribute.num_components * length);
+    outs.push_back(values[i].data());
+  }
+  DracoFunctions::copy_geometry(mesh, faces.data(), outs, 2);
+  DracoFunctions::release_geometry(mesh);
+  return 0;
+}
@@ -74,9 +74,9 @@ if is_windows:
       '/std:c++17', '/O2',
     ]
 else:
-    extra_link_args = ['-L{0}'.format(lib_dir) for lib_dir in lib_dirs] + library_link_args
+    extra_link_args = ['-L{0}'.format(lib_dir) for lib_dir in lib_dirs] + library_link_args + [ '-pthread' ]
     extra_compile_args = [
-      '-std=c++11','-O3'
+      '-std=c++11','-O3', '-pthread'
     ]
 
 if os.path.exists(".eggs"):
@@ -2,15 +2,33 @@
 #define __DRACOPY_H__
 
 #include<algorithm>
+#include<array>
+#include<atomic>
+#include<chrono>
 #include<cmath>
+#include<exception>
+#include<limits>
+#include<mutex>
+#include<queue>
+#include<thread>
 #include<vector>
 #include<cstddef>
+#include<cstring>
+#include<memory>
 #include<sstream>
+#include "draco/attributes/attribute_quantization_transform.h"
 #include "draco/compression/decode.h"
 #include "draco/compression/encode.h"
 #include "draco/compression/config/compression_shared.h"
+#include "draco/compression/config/decoder_options.h"
+#include "draco/compression/expert_encode.h"
+#include "draco/compression/mesh/mesh_edgebreaker_decoder.h"
+#include "draco/compression/mesh/mesh_sequential_decoder.h"
+#include "draco/compression/point_cloud/point_cloud_kd_tree_decoder.h"
+#include "draco/compression/point_cloud/point_cloud_sequential_decoder.h"
 #include "draco/core/status_or.h"
 #include "draco/core/encoder_buffer.h"
+#include "draco/core/varint_decoding.h"
 #include "draco/core/vector_d.h"
 #include "draco/mesh/triangle_soup_mesh_builder.h"
 #include "draco/point_cloud/point_cloud_builder.h"
@@ -21,12 +39,26 @@ namespace DracoFunctions {
     successful,
     not_draco_encoded,
     no_position_attribute,
-    failed_during_decoding
+    failed_during_decoding,
+    exceeds_limits
   };
   enum encoding_status {
     successful_encoding,
     failed_during_encoding
   };
+  // How duplicate mesh vertices are merged when the order is not preserved.
+  enum weld_mode {
+    weld_draco,  // Draco's DeduplicateAttributeValues on the built mesh
+    weld_none,  // not at all
+    weld_exact,  // vertices with identical values, before the mesh is built
+    weld_quantized  // same, comparing positions on the quantization grid
+  };
+  // The order point clouds are encoded in when it is not Draco's own.
+  enum point_order_mode {
+    order_input,  // as given
+    order_morton,  // along a Z-order curve over the bounding box
+    order_hilbert  // along a Hilbert curve, which has no long jumps
+  };
 
   struct AttributeData {
     int unique_id;
@@ -34,14 +66,62 @@ namespace DracoFunctions {
     int data_type;  // draco::DataType as int
     int attribute_type;  // draco::GeometryAttribute::Type as int
     std::string name;  // Attribute name from metadata
-    std::vector<float> float_data;    // For float data
-    std::vector<uint32_t> uint_data;  // For integer data
-    std::vector<uint8_t> byte_data;   // For byte data
+    int attribute_id;  // Index of the attribute in the decoded geometry
+    // Encoder settings recorded in the attribute metadata by encode();
+    // quantization_bits is -1 and prediction_scheme PREDICTION_UNDEFINED
+    // when absent, the grid is only set when it was explicit.
+    int quantization_bits;
+    double quantization_range;
+    std::vector<double> quantization_origin;
+    int prediction_scheme;
+  };
+
+  // What the native part of one decode or encode cost: wall-clock seconds
+  // per stage and the bytes held by the draco geometry. Only filled in
+  // when asked for; stages that did not run stay 0.
+  struct NativeStats {
+    double header;  // decode: sniffing the geometry type
+    double draco;  // Draco's own decode or encode
+    double describe;  // decode: attribute descriptions and metadata
+    double build;  // encode: building the draco::Mesh / PointCloud
+    std::size_t native_bytes;  // attribute values and faces of the geometry
+    std::size_t welded_vertices;  // encode: vertices merged into another one
+
+    NativeStats() : header(0), draco(0), describe(0), build(0), native_bytes(0), welded_vertices(0) {}
+  };
+
+  // Charges the time between consecutive laps to stages of a
+  // NativeStats. Does nothing, not even read the clock, without one.
+  class StageClock {
+   public:
+    explicit StageClock(NativeStats *stats) : stats_(stats) {
+      if (stats_) {
+        last_ = std::chrono::steady_clock::now();
+      }
+    }
+
+    void lap(double NativeStats::*stage) {
+      if (!stats_) {
+        return;
+      }
+      const auto now = std::chrono::steady_clock::now();
+      stats_->*stage += std::chrono::duration<double>(now - last_).count();
+      last_ = now;
+    }
+
+   private:
+    NativeStats *stats_;
+    std::chrono::steady_clock::time_point last_;
   };
 
   struct PointCloudObject {
     std::vector<AttributeData> attributes; 
 
+    // Decoded geometry; faces and attribute values are copied
+    // out of it into caller provided buffers.
+    std::shared_ptr<draco::PointCloud> geometry;
+    unsigned int num_points;
+
     // Encoding options stored in metadata
     bool encoding_options_set;
     bool colors_set;
@@ -49,25 +129,162 @@ namespace DracoFunctions {
     double quantization_range;
     std::vector<double> quantization_origin;
 
+    // Point order stored in the metadata by encode_point_cloud, and the
+    // unique id of the attribute holding the input index of each point
+    // (-1 without one).
+    int point_order;
+    int permutation_unique_id;
+
+    // Set when decoding with a bounding box: num_points counts the points
+    // inside it, whose indices in the geometry are cropped_points.
+    bool cropped;
+    std::vector<uint32_t> cropped_points;
+
     decoding_status decode_status;
+    std::string error_message;  // Draco's or the exceeded limit, on failure
+    NativeStats stats;
   };
 
   struct MeshObject : PointCloudObject {
-    std::vector<unsigned int> faces;
+    // Whether the buffer held a mesh; num_faces can still be 0, e.g.
+    // after cropping.
+    bool is_mesh;
+    unsigned int num_faces;
+    std::vector<uint32_t> cropped_faces;  // renumbered over cropped_points
+  };
+
+  // What probe_buffer reads from an encoded buffer: everything in a
+  // MeshObject except the geometry, plus the header fields.
+  struct ProbeObject : MeshObject {
+    int geometry_type;  // draco::EncodedGeometryType as int
+    int encoding_method;  // draco::MeshEncoderMethod or PointCloudEncodingMethod
   };
 
   struct EncodedObject {
-    std::vector<unsigned char> buffer;
+    std::vector<char> buffer;
     encoding_status encode_status;
+    NativeStats stats;
   };
 
+  // A borrowed, read-only view of an encoded buffer.
+  struct BufferView {
+    const char *data;
+    std::size_t size;
+  };
 
-#define CHECK_STATUS(statusor, obj) \
-    if (!(statusor).ok()) {\
-      std::string status_string = (statusor).status().error_msg_string(); \
+  // A borrowed, C-contiguous num_rows x num_components array of
+  // data_type values. Whoever fills it in keeps the memory alive.
+  struct ArrayView {
+    const void *data;
+    std::size_t num_rows;
+    int num_components;
+    int data_type;  // draco::DataType as int
+  };
+
+  // Encoder settings for the attributes of one type (|attribute_type| >= 0)
+  // or for one generic attribute (|generic_index|, its index in attr_data).
+  struct AttributeOptions {
+    int attribute_type;  // draco::GeometryAttribute::Type, or -1
+    int generic_index;  // -1 unless attribute_type is -1
+    int quantization_bits;  // -1 keeps Draco's default
+    std::vector<float> quantization_origin;  // explicit grid, with a positive
+    float quantization_range;                // range and one value per component
+    int prediction_scheme;  // draco::PredictionSchemeMethod
+  };
+
+  // Everything encode_mesh / encode_point_cloud need, gathered so that
+  // a batch of inputs can be prepared up front and encoded without the GIL.
+  // Arrays are borrowed in their original dtype and converted (if at all)
+  // only while the draco geometry is built.
+  struct EncodeInput {
+    bool is_mesh;
+    ArrayView points;
+    ArrayView faces;
+    int quantization_bits;
+    int compression_level;
+    float quantization_range;
+    std::vector<float> quantization_origin;
+    bool preserve_order;
+    bool create_metadata;
+    ArrayView colors;  // num_components == 0 when absent
+    ArrayView tex_coord;  // num_components == 0 when absent
+    ArrayView normals;  // num_components == 0 when absent
+    std::vector<int8_t> unique_ids;
+    std::vector<ArrayView> attr_data;
+    std::vector<std::string> attr_names;
+    std::vector<AttributeOptions> attribute_options;  // applied in order
+    int weld;  // weld_mode, ignored when preserve_order is set
+    // Point clouds only: point_order_mode the points are sorted in, the
+    // draco::PointCloudEncodingMethod (-1 picks sequential encoding when
+    // the order matters, kd-tree otherwise) and whether the input index
+    // of every point is stored as an attribute.
+    int point_order;
+    int encoding_method;
+    bool store_permutation;
+    int num_threads;  // for work within this one encode; 0 uses one per core
+    bool collect_stats;  // fill in the NativeStats of the result
+  };
+
+  // Runs fn(i) for every i in [0, n) on up to num_threads native threads
+  // (num_threads <= 0 means one per hardware thread). Work is handed out
+  // dynamically so uneven items balance. The first exception thrown by fn
+  // is rethrown on the calling thread after all workers have joined.
+  template <typename F>
+  void parallel_for(const std::size_t n, int num_threads, const F &fn) {
+    if (num_threads <= 0) {
+      num_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    const std::size_t num_workers = std::min(static_cast<std::size_t>(num_threads), n);
+    if (num_workers <= 1) {
+      for (std::size_t i = 0; i < n; ++i) {
+        fn(i);
+      }
+      return;
+    }
+
+    std::atomic<std::size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto work = [&]() {
+      std::size_t i;
+      while ((i = next.fetch_add(1)) < n) {
+        try {
+          fn(i);
+        }
+        catch (...) {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if (!error) {
+            error = std::current_exception();
+          }
+        }
+      }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(num_workers - 1);
+    for (std::size_t t = 1; t < num_workers; ++t) {
+      workers.emplace_back(work);
+    }
+    work();
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+
+// Returns |obj| with its decode_status and error_message set when the
+// draco::Status |status| failed. Draco reports input that is not a Draco
+// file at all with one of these two messages.
+#define CHECK_STATUS(status, obj) \
+    if (!(status).ok()) {\
+      const std::string status_string = (status).error_msg_string(); \
+      (obj).error_message = status_string; \
       if (\
-        status_string.compare("Not a Draco file.") \
-        || status_string.compare("Failed to parse Draco header.")) {\
+        status_string == "Not a Draco file." \
+        || status_string == "Failed to parse Draco header.") {\
 \
         (obj).decode_status = not_draco_encoded;\
       }\
@@ -77,161 +294,790 @@ namespace DracoFunctions {
       return (obj);\
     }
 
-  MeshObject decode_buffer(const char *buffer, std::size_t buffer_len) {
+  // Bytes held by the attribute values and faces of |pc|.
+  std::size_t geometry_bytes(const draco::PointCloud &pc, const std::size_t num_faces) {
+    std::size_t bytes = num_faces * sizeof(draco::Mesh::Face);
+    for (int i = 0; i < pc.num_attributes(); ++i) {
+      bytes += pc.attribute(i)->buffer()->data_size();
+    }
+    return bytes;
+  }
+
+  // Fills in the attribute descriptions and the encoding options stored
+  // in the metadata of |pc|. Values are copied later by copy_attribute.
+  void describe_geometry(const draco::PointCloud &pc, PointCloudObject &object) {
+    const draco::GeometryMetadata *metadata = pc.GetMetadata();
+
+    for (int att_id = 0; att_id < pc.num_attributes(); ++att_id) {
+      const auto *const att = pc.attribute(att_id);
+      
+      AttributeData attr;
+      attr.unique_id = att->unique_id();
+      attr.num_components = att->num_components();
+      attr.data_type = static_cast<int>(att->data_type());
+      attr.attribute_type = static_cast<int>(att->attribute_type());
+      attr.attribute_id = att_id;
+
+      attr.quantization_bits = -1;
+      attr.quantization_range = 0;
+      attr.prediction_scheme = draco::PREDICTION_UNDEFINED;
+      if (metadata) {
+        auto att_metadata = metadata->GetAttributeMetadataByUniqueId(attr.unique_id);
+        if (att_metadata) {
+          att_metadata->GetEntryString("name", &(attr.name));
+          att_metadata->GetEntryInt("quantization_bits", &(attr.quantization_bits));
+          att_metadata->GetEntryDouble("quantization_range", &(attr.quantization_range));
+          att_metadata->GetEntryDoubleArray("quantization_origin", &(attr.quantization_origin));
+          att_metadata->GetEntryInt("prediction_scheme", &(attr.prediction_scheme));
+        }
+      }
+
+      object.attributes.push_back(attr);
+    }
+
+    // Set encoding options from metadata
+    object.encoding_options_set = false;
+    object.point_order = order_input;
+    object.permutation_unique_id = -1;
+    if (metadata) {
+      metadata->GetEntryInt("point_order", &(object.point_order));
+      metadata->GetEntryInt("point_permutation", &(object.permutation_unique_id));
+      metadata->GetEntryInt("quantization_bits", &(object.quantization_bits));
+      if (metadata->GetEntryDouble("quantization_range", &(object.quantization_range)) &&
+          metadata->GetEntryDoubleArray("quantization_origin", &(object.quantization_origin))) {
+          object.encoding_options_set = true;
+      }
+    }
+  }
+
+  // Which attributes decode_buffer keeps: those whose type, unique id or
+  // metadata name is listed, or every attribute when |all| is set.
+  struct AttributeFilter {
+    bool all;
+    std::vector<int> types;
+    std::vector<int> unique_ids;
+    std::vector<std::string> names;
+
+    AttributeFilter() : all(true) {}
+
+    // Whether some attribute of |type| could be kept. Unique ids and names
+    // are only known once decoded, so any of them may match any type.
+    bool may_keep_type(const int type) const {
+      return all || !unique_ids.empty() || !names.empty()
+        || std::find(types.begin(), types.end(), type) != types.end();
+    }
+
+    bool keeps(const draco::PointAttribute &att, const draco::GeometryMetadata *metadata) const {
+      if (all) {
+        return true;
+      }
+      if (std::find(types.begin(), types.end(), static_cast<int>(att.attribute_type())) != types.end()
+          || std::find(unique_ids.begin(), unique_ids.end(), static_cast<int>(att.unique_id())) != unique_ids.end()) {
+        return true;
+      }
+      if (metadata && !names.empty()) {
+        auto att_metadata = metadata->GetAttributeMetadataByUniqueId(att.unique_id());
+        std::string name;
+        if (att_metadata && att_metadata->GetEntryString("name", &name)) {
+          return std::find(names.begin(), names.end(), name) != names.end();
+        }
+      }
+      return false;
+    }
+  };
+
+  // Caps for decoding untrusted input, 0 leaving a count unbounded.
+  // output_bytes counts the decoded faces and attribute values.
+  struct DecodeLimits {
+    uint64_t max_points;
+    uint64_t max_faces;
+    uint64_t max_attributes;
+    uint64_t max_output_bytes;
+
+    DecodeLimits() : max_points(0), max_faces(0), max_attributes(0), max_output_bytes(0) {}
+
+    bool any() const { return max_points || max_faces || max_attributes || max_output_bytes; }
+  };
+
+  struct DecodeOptions {
+    AttributeFilter attributes;
+    // Keep positions as integers on the quantization grid instead of
+    // dequantizing them; the grid is reported as the encoding options.
+    bool quantized_positions;
+    // Fill in the NativeStats of the result.
+    bool collect_stats;
+    // Only keep the points inside this box (min xyz, max xyz, in the units
+    // of the returned positions) and the faces between them; empty keeps
+    // everything.
+    std::vector<double> bbox;
+    DecodeLimits limits;
+
+    DecodeOptions() : quantized_positions(false), collect_stats(false) {}
+  };
+
+  // Whether a geometry of these sizes is within |limits|, counting its
+  // faces towards the output bytes; if not, says which limit it exceeds
+  // in |error|.
+  bool within_limits(const DecodeLimits &limits, const uint64_t num_points, const uint64_t num_faces, std::string &error) {
+    std::ostringstream oss;
+    const uint64_t face_bytes = num_faces * sizeof(draco::Mesh::Face);
+    if (limits.max_points && num_points > limits.max_points) {
+      oss << num_points << " points exceed the limit of " << limits.max_points << ".";
+    }
+    else if (limits.max_faces && num_faces > limits.max_faces) {
+      oss << num_faces << " faces exceed the limit of " << limits.max_faces << ".";
+    }
+    else if (limits.max_output_bytes && face_bytes > limits.max_output_bytes) {
+      oss << face_bytes << " bytes of faces exceed the output limit of " << limits.max_output_bytes << ".";
+    }
+    else {
+      return true;
+    }
+    error = oss.str();
+    return false;
+  }
+
+  // Reads the face count and a lower bound of the point count at the start
+  // of mesh connectivity, without consuming the decoder's buffer. Only the
+  // layout of bitstream 2.2, which this library writes, is known.
+  bool peek_connectivity_counts(draco::DecoderBuffer buffer, const int method, const uint16_t version, uint32_t &num_faces, uint32_t &num_points) {
+    if (version != DRACO_BITSTREAM_VERSION(2, 2)) {
+      return false;
+    }
+    if (method == draco::MESH_SEQUENTIAL_ENCODING) {
+      return draco::DecodeVarint(&num_faces, &buffer) && draco::DecodeVarint(&num_points, &buffer);
+    }
+    if (method == draco::MESH_EDGEBREAKER_ENCODING) {
+      // Encoded vertices, to which attribute seams add points.
+      return draco::DecodeVarint(&num_points, &buffer) && draco::DecodeVarint(&num_faces, &buffer);
+    }
+    return false;
+  }
+
+  // A Draco decoder that enforces DecodeLimits while it decodes. The
+  // header holds no counts, so each limit is checked as soon as Draco has
+  // read what it bounds:
+  //  - points, faces and the faces' bytes before mesh connectivity is
+  //    decoded, for bitstream 2.2 meshes (see LimitedMeshDecoder), and
+  //    otherwise once the geometry data is decoded, by which time Draco
+  //    has allocated the faces and the corner table;
+  //  - the point count of point clouds before anything is allocated for
+  //    it;
+  //  - the attribute count and all output bytes before any attribute
+  //    values are decoded.
+  template <class DecoderT>
+  class LimitedDecoder : public DecoderT {
+   public:
+    LimitedDecoder(const DecodeLimits &limits, const int method) : limits_(limits), method_(method) {}
+
+    // Which limit made decoding fail, empty if none did.
+    const std::string &limit_error() const { return error_; }
+
+   protected:
+    uint64_t num_faces() const {
+      const draco::Mesh *mesh = dynamic_cast<const draco::Mesh*>(this->point_cloud());
+      return mesh ? mesh->num_faces() : 0;
+    }
+
+    bool DecodeGeometryData() override {
+      return DecoderT::DecodeGeometryData() && within_limits(limits_, this->point_cloud()->num_points(), num_faces(), error_);
+    }
+
+    bool DecodeAllAttributes() override {
+      const draco::PointCloud *pc = this->point_cloud();
+      std::ostringstream oss;
+      uint64_t bytes_per_point = 0;
+      for (int i = 0; i < pc->num_attributes(); ++i) {
+        const int length = draco::DataTypeLength(pc->attribute(i)->data_type());
+        bytes_per_point += pc->attribute(i)->num_components() * static_cast<uint64_t>(length > 0 ? length : 4);
+      }
+      const uint64_t output_bytes = num_faces() * sizeof(draco::Mesh::Face) + pc->num_points() * bytes_per_point;
+      if (limits_.max_attributes && static_cast<uint64_t>(pc->num_attributes()) > limits_.max_attributes) {
+        oss << pc->num_attributes() << " attributes exceed the limit of " << limits_.max_attributes << ".";
+      }
+      else if (limits_.max_output_bytes && output_bytes > limits_.max_output_bytes) {
+        oss << output_bytes << " bytes of output exceed the limit of " << limits_.max_output_bytes << ".";
+      }
+      else {
+        return DecoderT::DecodeAllAttributes();
+      }
+      error_ = oss.str();
+      return false;
+    }
+
+    const DecodeLimits limits_;
+    const int method_;
+    std::string error_;
+  };
+
+  // Same as LimitedDecoder for meshes, also checking the counts at the
+  // start of the connectivity before it is decoded.
+  template <class DecoderT>
+  class LimitedMeshDecoder : public LimitedDecoder<DecoderT> {
+   public:
+    using LimitedDecoder<DecoderT>::LimitedDecoder;
+
+   protected:
+    bool DecodeConnectivity() override {
+      uint32_t num_faces = 0, num_points = 0;
+      if (peek_connectivity_counts(*this->buffer(), this->method_, this->bitstream_version(), num_faces, num_points)
+          && !within_limits(this->limits_, num_points, num_faces, this->error_)) {
+        return false;
+      }
+      return DecoderT::DecodeConnectivity();
+    }
+  };
+
+  template <class LimitedT, class GeometryT>
+  draco::Status decode_limited(draco::DecoderBuffer *buffer, const draco::DecoderOptions &draco_options, const DecodeLimits &limits, const int method, GeometryT *geometry, std::string &limit_error) {
+    LimitedT decoder(limits, method);
+    const draco::Status status = decoder.Decode(draco_options, buffer, geometry);
+    limit_error = decoder.limit_error();
+    return status;
+  }
+
+  // Decodes |buffer| into |geometry| (a draco::Mesh for meshes) as
+  // draco::Decoder would with |draco_options|, but with the decoder its
+  // header selects wrapped in a LimitedDecoder. An exceeded limit is
+  // described in |limit_error|.
+  draco::Status decode_limited(draco::DecoderBuffer *buffer, const draco::DecoderOptions &draco_options, const DecodeLimits &limits, draco::PointCloud *geometry, std::string &limit_error) {
+    draco::DecoderBuffer header_buffer = *buffer;
+    draco::DracoHeader header;
+    DRACO_RETURN_IF_ERROR(draco::PointCloudDecoder::DecodeHeader(&header_buffer, &header));
+    const int method = header.encoder_method;
+    draco::Mesh *mesh = dynamic_cast<draco::Mesh*>(geometry);
+    if (header.encoder_type == draco::TRIANGULAR_MESH && mesh) {
+      if (method == draco::MESH_EDGEBREAKER_ENCODING) {
+        return decode_limited<LimitedMeshDecoder<draco::MeshEdgebreakerDecoder>>(buffer, draco_options, limits, method, mesh, limit_error);
+      }
+      if (method == draco::MESH_SEQUENTIAL_ENCODING) {
+        return decode_limited<LimitedMeshDecoder<draco::MeshSequentialDecoder>>(buffer, draco_options, limits, method, mesh, limit_error);
+      }
+    }
+    else if (header.encoder_type == draco::POINT_CLOUD && !mesh) {
+      if (method == draco::POINT_CLOUD_KD_TREE_ENCODING) {
+        return decode_limited<LimitedDecoder<draco::PointCloudKdTreeDecoder>>(buffer, draco_options, limits, method, geometry, limit_error);
+      }
+      if (method == draco::POINT_CLOUD_SEQUENTIAL_ENCODING) {
+        return decode_limited<LimitedDecoder<draco::PointCloudSequentialDecoder>>(buffer, draco_options, limits, method, geometry, limit_error);
+      }
+    }
+    return draco::Status(draco::Status::DRACO_ERROR, "Unsupported encoding method.");
+  }
+
+  // Restricts |meshObject| to the points of |pc| whose position lies in
+  // |bbox| and to the faces of |mesh|, if any, whose three corners do.
+  // Kept points are renumbered in order; only their indices are stored
+  // here, the copies gather their values.
+  void crop_geometry(const draco::PointCloud &pc, const draco::Mesh *mesh, const std::vector<double> &bbox, MeshObject &meshObject) {
+    const draco::PointAttribute *positions = pc.GetNamedAttribute(draco::GeometryAttribute::POSITION);
+    const uint32_t num_points = pc.num_points();
+    meshObject.cropped = true;
+    meshObject.cropped_points.clear();
+    meshObject.cropped_faces.clear();
+
+    std::vector<uint32_t> remap(num_points, std::numeric_limits<uint32_t>::max());
+    double xyz[3];
+    for (draco::PointIndex v(0); positions && v < num_points; ++v) {
+      positions->ConvertValue<double>(positions->mapped_index(v), 3, xyz);
+      if (xyz[0] >= bbox[0] && xyz[1] >= bbox[1] && xyz[2] >= bbox[2]
+          && xyz[0] <= bbox[3] && xyz[1] <= bbox[4] && xyz[2] <= bbox[5]) {
+        remap[v.value()] = static_cast<uint32_t>(meshObject.cropped_points.size());
+        meshObject.cropped_points.push_back(v.value());
+      }
+    }
+    meshObject.num_points = meshObject.cropped_points.size();
+
+    if (!mesh) {
+      return;
+    }
+    for (draco::FaceIndex f(0); f < mesh->num_faces(); ++f) {
+      const draco::Mesh::Face &face = mesh->face(f);
+      const uint32_t corners[3] = { remap[face[0].value()], remap[face[1].value()], remap[face[2].value()] };
+      if (corners[0] != std::numeric_limits<uint32_t>::max()
+          && corners[1] != std::numeric_limits<uint32_t>::max()
+          && corners[2] != std::numeric_limits<uint32_t>::max()) {
+        meshObject.cropped_faces.insert(meshObject.cropped_faces.end(), corners, corners + 3);
+      }
+    }
+    meshObject.num_faces = meshObject.cropped_faces.size() / 3;
+  }
+
+  // Tells |decoder| to skip the transforms (dequantization, normal
+  // decoding) of attribute types |options| can not select, and of
+  // positions when they are to stay quantized. Positions are still
+  // dequantized for a crop box, which is in the units of the returned
+  // positions. Every type is set, so a decoder can be reconfigured.
+  void configure_decoder(draco::Decoder &decoder, const DecodeOptions &options) {
+    const draco::GeometryAttribute::Type attribute_types[] = {
+      draco::GeometryAttribute::POSITION, draco::GeometryAttribute::NORMAL,
+      draco::GeometryAttribute::COLOR, draco::GeometryAttribute::TEX_COORD,
+      draco::GeometryAttribute::GENERIC,
+    };
+    for (const auto type : attribute_types) {
+      bool skip = !options.attributes.may_keep_type(type);
+      if (type == draco::GeometryAttribute::POSITION) {
+        skip = options.quantized_positions || (skip && options.bbox.empty());
+      }
+      decoder.options()->SetAttributeBool(type, "skip_attribute_transform", skip);
+    }
+  }
+
+  // Decodes |buffer| with |decoder|, set up by configure_decoder for
+  // |options|, keeping only the attributes selected by
+  // |options.attributes|. Draco still decodes every attribute's values,
+  // but dropped attributes are freed before anything is described or
+  // copied.
+  MeshObject decode_buffer(draco::Decoder &decoder, const char *buffer, std::size_t buffer_len, const DecodeOptions &options) {
+    const AttributeFilter &filter = options.attributes;
     MeshObject meshObject;
+    meshObject.num_points = 0;
+    meshObject.num_faces = 0;
+    meshObject.cropped = false;
+    meshObject.is_mesh = false;
+    StageClock clock(options.collect_stats ? &meshObject.stats : nullptr);
     draco::DecoderBuffer decoderBuffer;
     decoderBuffer.Init(buffer, buffer_len);
 
     auto type_statusor = draco::Decoder::GetEncodedGeometryType(&decoderBuffer);
-    CHECK_STATUS(type_statusor, meshObject)
+    CHECK_STATUS(type_statusor.status(), meshObject)
     draco::EncodedGeometryType geotype = std::move(type_statusor).value();
+    meshObject.is_mesh = geotype == draco::TRIANGULAR_MESH;
+    clock.lap(&NativeStats::header);
 
     if (geotype == draco::EncodedGeometryType::INVALID_GEOMETRY_TYPE) {
       meshObject.decode_status = not_draco_encoded;
       return meshObject;
     }
 
-    draco::Decoder decoder;
     std::unique_ptr<draco::Mesh> in_mesh;
     std::unique_ptr<draco::PointCloud> in_pointcloud;
     draco::Mesh *mesh;
+    std::string limit_error;
 
     if (geotype == draco::EncodedGeometryType::POINT_CLOUD) {
-      auto statusor = decoder.DecodePointCloudFromBuffer(&decoderBuffer);
-      CHECK_STATUS(statusor, meshObject)
-      in_pointcloud = std::move(statusor).value();
+      if (options.limits.any()) {
+        in_pointcloud.reset(new draco::PointCloud());
+        const draco::Status status = decode_limited(&decoderBuffer, *decoder.options(), options.limits, in_pointcloud.get(), limit_error);
+        if (!limit_error.empty()) {
+          meshObject.decode_status = exceeds_limits;
+          meshObject.error_message = limit_error;
+          return meshObject;
+        }
+        CHECK_STATUS(status, meshObject)
+      }
+      else {
+        auto statusor = decoder.DecodePointCloudFromBuffer(&decoderBuffer);
+        CHECK_STATUS(statusor.status(), meshObject)
+        in_pointcloud = std::move(statusor).value();
+      }
       // This is okay because draco::Mesh is a subclass of
       // draco::PointCloud
       mesh = static_cast<draco::Mesh*>(in_pointcloud.get());
     }
     else if (geotype == draco::EncodedGeometryType::TRIANGULAR_MESH) {
-      auto statusor = decoder.DecodeMeshFromBuffer(&decoderBuffer);
-      CHECK_STATUS(statusor, meshObject)
-      in_mesh = std::move(statusor).value();
+      if (options.limits.any()) {
+        in_mesh.reset(new draco::Mesh());
+        const draco::Status status = decode_limited(&decoderBuffer, *decoder.options(), options.limits, in_mesh.get(), limit_error);
+        if (!limit_error.empty()) {
+          meshObject.decode_status = exceeds_limits;
+          meshObject.error_message = limit_error;
+          return meshObject;
+        }
+        CHECK_STATUS(status, meshObject)
+      }
+      else {
+        auto statusor = decoder.DecodeMeshFromBuffer(&decoderBuffer);
+        CHECK_STATUS(statusor.status(), meshObject)
+        in_mesh = std::move(statusor).value();
+      }
       mesh = in_mesh.get();
+      meshObject.num_faces = mesh->num_faces();
     }
     else {
       throw std::runtime_error("Should never be reached.");
     }
+    clock.lap(&NativeStats::draco);
 
+    meshObject.num_points = mesh->num_points();
+    if (options.bbox.size() == 6) {
+      // Before filtering, which may drop the positions.
+      crop_geometry(*mesh, in_mesh.get(), options.bbox, meshObject);
+    }
+    if (!filter.all) {
+      const draco::GeometryMetadata *metadata = mesh->GetMetadata();
+      for (int att_id = mesh->num_attributes() - 1; att_id >= 0; --att_id) {
+        if (!filter.keeps(*mesh->attribute(att_id), metadata)) {
+          mesh->DeleteAttribute(att_id);
+        }
+      }
+    }
+    describe_geometry(*mesh, meshObject);
 
-    // Get faces if it's a mesh
-    if (geotype == draco::EncodedGeometryType::TRIANGULAR_MESH) {
-      meshObject.faces.reserve(3 * mesh->num_faces());
-      for (draco::FaceIndex f(0); f < mesh->num_faces(); ++f) {
-        const auto& face = mesh->face(f);
-        meshObject.faces.push_back(face[0].value());
-        meshObject.faces.push_back(face[1].value());
-        meshObject.faces.push_back(face[2].value());
+    // Positions that were left quantized carry their grid in the
+    // transform data, which is authoritative over any metadata.
+    const draco::PointAttribute *positions = mesh->GetNamedAttribute(draco::GeometryAttribute::POSITION);
+    draco::AttributeQuantizationTransform quantization;
+    if (options.quantized_positions && positions && quantization.InitFromAttribute(*positions)) {
+      meshObject.encoding_options_set = true;
+      meshObject.quantization_bits = quantization.quantization_bits();
+      meshObject.quantization_range = quantization.range();
+      meshObject.quantization_origin.clear();
+      for (int axis = 0; axis < positions->num_components(); ++axis) {
+        meshObject.quantization_origin.push_back(quantization.min_value(axis));
       }
     }
+    clock.lap(&NativeStats::describe);
+    if (options.collect_stats) {
+      meshObject.stats.native_bytes = geometry_bytes(*mesh, in_mesh ? in_mesh->num_faces() : 0);
+    }
 
-    const draco::GeometryMetadata *metadata = mesh->GetMetadata();
+    if (in_mesh) {
+      meshObject.geometry = std::move(in_mesh);
+    }
+    else {
+      meshObject.geometry = std::move(in_pointcloud);
+    }
 
-    // Collect all attributes in a unified way
-    // std::cout << "DEBUG: Collecting all attributes, total: " << mesh->num_attributes() << std::endl;
-    for (int att_id = 0; att_id < mesh->num_attributes(); ++att_id) {
-      const auto *const att = mesh->attribute(att_id);
-      
-      AttributeData attr;
-      attr.unique_id = att->unique_id();
-      attr.num_components = att->num_components();
-      attr.data_type = static_cast<int>(att->data_type());
-      attr.attribute_type = static_cast<int>(att->attribute_type());
+    meshObject.decode_status = successful;
+    return meshObject;
+  }
 
-      if (metadata) {
-        auto att_metadata = metadata->GetAttributeMetadataByUniqueId(attr.unique_id);
-        if (att_metadata) {
-          att_metadata->GetEntryString("name", &(attr.name));
-        }
+  // Decodes everything up to and including the attribute descriptions but
+  // skips decoding the attribute values themselves.
+  template <class DecoderT>
+  class ProbeDecoder : public DecoderT {
+   protected:
+    bool DecodeAllAttributes() override { return true; }
+  };
+
+  template <class DecoderT, class GeometryT>
+  draco::Status probe_geometry(draco::DecoderBuffer *buffer, GeometryT *geometry) {
+    ProbeDecoder<DecoderT> decoder;
+    draco::DecoderOptions options;
+    return decoder.Decode(options, buffer, geometry);
+  }
+
+  // Like decode_buffer but only describes the geometry: the header picks
+  // the decoder Draco would use, which then decodes the metadata,
+  // connectivity and attribute descriptions but no attribute values.
+  // The returned object has no geometry to copy values from.
+  ProbeObject probe_buffer(const char *buffer, std::size_t buffer_len) {
+    ProbeObject probeObject;
+    probeObject.num_points = 0;
+    probeObject.num_faces = 0;
+    probeObject.cropped = false;
+    probeObject.is_mesh = false;
+    probeObject.encoding_options_set = false;
+    probeObject.geometry_type = draco::INVALID_GEOMETRY_TYPE;
+    probeObject.encoding_method = -1;
+
+    draco::DracoHeader header;
+    draco::DecoderBuffer headerBuffer;
+    headerBuffer.Init(buffer, buffer_len);
+    if (!draco::PointCloudDecoder::DecodeHeader(&headerBuffer, &header).ok()) {
+      probeObject.decode_status = not_draco_encoded;
+      return probeObject;
+    }
+    probeObject.geometry_type = header.encoder_type;
+    probeObject.is_mesh = header.encoder_type == draco::TRIANGULAR_MESH;
+    probeObject.encoding_method = header.encoder_method;
+
+    draco::DecoderBuffer decoderBuffer;
+    decoderBuffer.Init(buffer, buffer_len);
+    std::unique_ptr<draco::PointCloud> geometry;
+    draco::Status status(draco::Status::DRACO_ERROR, "Unknown encoding method.");
+
+    if (header.encoder_type == draco::TRIANGULAR_MESH) {
+      std::unique_ptr<draco::Mesh> mesh(new draco::Mesh());
+      if (header.encoder_method == draco::MESH_EDGEBREAKER_ENCODING) {
+        status = probe_geometry<draco::MeshEdgebreakerDecoder>(&decoderBuffer, mesh.get());
+      }
+      else if (header.encoder_method == draco::MESH_SEQUENTIAL_ENCODING) {
+        status = probe_geometry<draco::MeshSequentialDecoder>(&decoderBuffer, mesh.get());
+      }
+      probeObject.num_faces = mesh->num_faces();
+      geometry = std::move(mesh);
+    }
+    else if (header.encoder_type == draco::POINT_CLOUD) {
+      geometry.reset(new draco::PointCloud());
+      if (header.encoder_method == draco::POINT_CLOUD_KD_TREE_ENCODING) {
+        status = probe_geometry<draco::PointCloudKdTreeDecoder>(&decoderBuffer, geometry.get());
+      }
+      else if (header.encoder_method == draco::POINT_CLOUD_SEQUENTIAL_ENCODING) {
+        status = probe_geometry<draco::PointCloudSequentialDecoder>(&decoderBuffer, geometry.get());
       }
+    }
+    else {
+      probeObject.decode_status = not_draco_encoded;
+      return probeObject;
+    }
 
-      // Extract data based on data type
-      const int num_values = mesh->num_points() * att->num_components();
+    if (!status.ok()) {
+      probeObject.num_faces = 0;
+      probeObject.decode_status = failed_during_decoding;
+      return probeObject;
+    }
 
-      switch (att->data_type()) {
-        case draco::DT_FLOAT32: {
-          attr.float_data.reserve(num_values);
-          std::unique_ptr<float[]> values(new float[att->num_components()]);
-          for (draco::PointIndex v(0); v < mesh->num_points(); ++v) {
-            if (att->ConvertValue<float>(att->mapped_index(v), att->num_components(), values.get())) {
-              for (int c = 0; c < att->num_components(); ++c) {
-                attr.float_data.push_back(values[c]);
-              }
-            }
-          }
-          break;
-        }
-        case draco::DT_UINT8: {
-          attr.byte_data.reserve(num_values);
-          std::unique_ptr<uint8_t[]> values(new uint8_t[att->num_components()]);
-          for (draco::PointIndex v(0); v < mesh->num_points(); ++v) {
-            if (att->ConvertValue<uint8_t>(att->mapped_index(v), att->num_components(), values.get())) {
-              for (int c = 0; c < att->num_components(); ++c) {
-                attr.byte_data.push_back(values[c]);
-              }
-            }
-          }
-          break;
-        }
-        case draco::DT_UINT16: {
-          attr.uint_data.reserve(num_values);
-          std::unique_ptr<uint16_t[]> values(new uint16_t[att->num_components()]);
-          for (draco::PointIndex v(0); v < mesh->num_points(); ++v) {
-            if (att->ConvertValue<uint16_t>(att->mapped_index(v), att->num_components(), values.get())) {
-              for (int c = 0; c < att->num_components(); ++c) {
-                attr.uint_data.push_back(static_cast<uint32_t>(values[c]));
-              }
-            }
-          }
-          break;
-        }
-        case draco::DT_UINT32: {
-          attr.uint_data.reserve(num_values);
-          std::unique_ptr<uint32_t[]> values(new uint32_t[att->num_components()]);
-          for (draco::PointIndex v(0); v < mesh->num_points(); ++v) {
-            if (att->ConvertValue<uint32_t>(att->mapped_index(v), att->num_components(), values.get())) {
-              for (int c = 0; c < att->num_components(); ++c) {
-                attr.uint_data.push_back(values[c]);
-              }
-            }
-          }
-          break;
-        }
-        default: {
-          // For other data types, try to convert to float as fallback
-          attr.float_data.reserve(num_values);
-          std::unique_ptr<float[]> values(new float[att->num_components()]);
-          for (draco::PointIndex v(0); v < mesh->num_points(); ++v) {
-            if (att->ConvertValue<float>(att->mapped_index(v), att->num_components(), values.get())) {
-              for (int c = 0; c < att->num_components(); ++c) {
-                attr.float_data.push_back(values[c]);
-              }
-            }
-          }
-          break;
-        }
+    probeObject.num_points = geometry->num_points();
+    describe_geometry(*geometry, probeObject);
+    probeObject.decode_status = successful;
+    return probeObject;
+  }
+
+
+  // The draco::DataType an attribute is copied out as. Attributes keep
+  // the width they were encoded with; only invalid types fall back
+  // to float.
+  int decoded_data_type(const int data_type) {
+    if (data_type <= draco::DT_INVALID || data_type >= draco::DT_TYPES_COUNT) {
+      return draco::DT_FLOAT32;
+    }
+    return data_type;
+  }
+
+  // The draco::DataType stored for a C++ value type.
+  template <typename T> struct DataTypeOf { static const draco::DataType value = draco::DT_INVALID; };
+  template <> struct DataTypeOf<int8_t> { static const draco::DataType value = draco::DT_INT8; };
+  template <> struct DataTypeOf<uint8_t> { static const draco::DataType value = draco::DT_UINT8; };
+  template <> struct DataTypeOf<int16_t> { static const draco::DataType value = draco::DT_INT16; };
+  template <> struct DataTypeOf<uint16_t> { static const draco::DataType value = draco::DT_UINT16; };
+  template <> struct DataTypeOf<int32_t> { static const draco::DataType value = draco::DT_INT32; };
+  template <> struct DataTypeOf<uint32_t> { static const draco::DataType value = draco::DT_UINT32; };
+  template <> struct DataTypeOf<int64_t> { static const draco::DataType value = draco::DT_INT64; };
+  template <> struct DataTypeOf<uint64_t> { static const draco::DataType value = draco::DT_UINT64; };
+  template <> struct DataTypeOf<float> { static const draco::DataType value = draco::DT_FLOAT32; };
+  template <> struct DataTypeOf<double> { static const draco::DataType value = draco::DT_FLOAT64; };
+
+  // Copies num_points values of N components through the point to value
+  // mapping, for points first to first + num_points - 1 or, when |points|
+  // is given, for the points listed there at those positions. N is a
+  // compile time constant so the per point copy unrolls (and vectorizes
+  // where the target allows) instead of looping over components.
+  template <typename T, int N>
+  void gather_attribute_values(const draco::PointAttribute *att, const uint32_t first, const uint32_t num_points, const uint32_t *points, T *out) {
+    const uint8_t *src = att->GetAddress(draco::AttributeValueIndex(0));
+    const std::size_t byte_stride = att->byte_stride();
+    for (uint32_t i = first; i < first + num_points; ++i) {
+      const draco::PointIndex v(points ? points[i] : i);
+      std::memcpy(out, src + byte_stride * att->mapped_index(v).value(), sizeof(T) * N);
+      out += N;
+    }
+  }
+
+  // Same as above for component counts without a specialization.
+  template <typename T>
+  void gather_attribute_values(const draco::PointAttribute *att, const uint32_t first, const uint32_t num_points, const uint32_t *points, T *out) {
+    const uint8_t *src = att->GetAddress(draco::AttributeValueIndex(0));
+    const std::size_t byte_stride = att->byte_stride();
+    const std::size_t value_size = sizeof(T) * att->num_components();
+    for (uint32_t i = first; i < first + num_points; ++i) {
+      const draco::PointIndex v(points ? points[i] : i);
+      std::memcpy(out, src + byte_stride * att->mapped_index(v).value(), value_size);
+      out += att->num_components();
+    }
+  }
+
+  // Writes num_points values of |att| into |out| as T, for the points
+  // from |first| on or, when given, those listed in |points| from
+  // position |first| on. Attributes already stored as T are copied with
+  // a single memcpy when the mapping is the identity and points are not
+  // listed, and with a typed gather otherwise. Anything else goes through
+  // draco's per value ConvertValue.
+  template <typename T>
+  void copy_attribute_values(const draco::PointAttribute *att, const uint32_t first, const uint32_t num_points, const uint32_t *points, T *out) {
+    const int num_components = att->num_components();
+    if (num_points == 0 || num_components == 0) {
+      return;
+    }
+
+    const bool packed = att->byte_stride() == static_cast<int64_t>(sizeof(T) * num_components);
+    if (att->data_type() == DataTypeOf<T>::value && packed) {
+      if (!points && att->is_mapping_identity() && att->size() >= first + num_points) {
+        std::memcpy(out, att->GetAddress(draco::AttributeValueIndex(first)), sizeof(T) * num_components * num_points);
+        return;
+      }
+      switch (num_components) {
+        case 1: gather_attribute_values<T, 1>(att, first, num_points, points, out); return;
+        case 2: gather_attribute_values<T, 2>(att, first, num_points, points, out); return;
+        case 3: gather_attribute_values<T, 3>(att, first, num_points, points, out); return;
+        case 4: gather_attribute_values<T, 4>(att, first, num_points, points, out); return;
+        default: gather_attribute_values<T>(att, first, num_points, points, out); return;
       }
-      
-      meshObject.attributes.push_back(attr);
-      // std::cout << "DEBUG: Added attribute " << att_id << " with type " << static_cast<int>(att->attribute_type()) << std::endl;
     }
 
-    // Set encoding options from metadata
-    meshObject.encoding_options_set = false;
-    if (metadata) {
-      metadata->GetEntryInt("quantization_bits", &(meshObject.quantization_bits));
-      if (metadata->GetEntryDouble("quantization_range", &(meshObject.quantization_range)) &&
-          metadata->GetEntryDoubleArray("quantization_origin", &(meshObject.quantization_origin))) {
-          meshObject.encoding_options_set = true;
+    for (uint32_t i = first; i < first + num_points; ++i) {
+      const draco::PointIndex v(points ? points[i] : i);
+      if (!att->ConvertValue<T>(att->mapped_index(v), num_components, out)) {
+        std::fill(out, out + num_components, T(0));
       }
+      out += num_components;
     }
+  }
 
-    meshObject.decode_status = successful;
-    return meshObject;
+  // Writes faces [begin, end) of a decoded mesh into their rows of |out|,
+  // which has room for 3 * num_faces values.
+  void copy_face_range(const MeshObject &meshObject, const std::size_t begin, const std::size_t end, uint32_t *out) {
+    if (begin >= end) {
+      return;
+    }
+    if (meshObject.cropped) {
+      std::memcpy(out + 3 * begin, meshObject.cropped_faces.data() + 3 * begin, 3 * sizeof(uint32_t) * (end - begin));
+      return;
+    }
+    // A face is three PointIndex values, each a thin wrapper around
+    // uint32_t, stored contiguously; copy them all at once.
+    static_assert(sizeof(draco::Mesh::Face) == 3 * sizeof(uint32_t), "Unexpected draco::Mesh::Face layout.");
+    const draco::Mesh *mesh = static_cast<const draco::Mesh*>(meshObject.geometry.get());
+    std::memcpy(out + 3 * begin, &mesh->face(draco::FaceIndex(begin)), sizeof(draco::Mesh::Face) * (end - begin));
+  }
+
+  // Writes the faces of a decoded mesh into |out|, which must have
+  // room for 3 * num_faces values.
+  void copy_faces(const MeshObject &meshObject, uint32_t *out) {
+    copy_face_range(meshObject, 0, meshObject.num_faces, out);
+  }
+
+  // Writes the values of points [begin, end) of |att| into their rows of
+  // |out|, a num_points x num_components array of T.
+  template <typename T>
+  void copy_attribute_rows(const draco::PointAttribute *att, const uint32_t begin, const uint32_t end, const uint32_t *points, void *out) {
+    T *rows = static_cast<T*>(out) + static_cast<std::size_t>(begin) * att->num_components();
+    copy_attribute_values<T>(att, begin, end - begin, points, rows);
+  }
+
+  // Writes the values of points [begin, end) of attributes[index] into
+  // their rows of |out|, which has room for num_points * num_components
+  // values of decoded_data_type.
+  void copy_attribute_range(const MeshObject &meshObject, const int index, const uint32_t begin, const uint32_t end, void *out) {
+    const AttributeData &attr = meshObject.attributes.at(index);
+    const draco::PointAttribute *att = meshObject.geometry->attribute(attr.attribute_id);
+    const uint32_t *points = meshObject.cropped ? meshObject.cropped_points.data() : nullptr;
+    if (begin >= end) {
+      return;
+    }
+
+    switch (decoded_data_type(attr.data_type)) {
+      case draco::DT_INT8: copy_attribute_rows<int8_t>(att, begin, end, points, out); break;
+      case draco::DT_UINT8:
+      case draco::DT_BOOL:  // One byte per value, copied as is
+        copy_attribute_rows<uint8_t>(att, begin, end, points, out);
+        break;
+      case draco::DT_INT16: copy_attribute_rows<int16_t>(att, begin, end, points, out); break;
+      case draco::DT_UINT16: copy_attribute_rows<uint16_t>(att, begin, end, points, out); break;
+      case draco::DT_INT32: copy_attribute_rows<int32_t>(att, begin, end, points, out); break;
+      case draco::DT_UINT32: copy_attribute_rows<uint32_t>(att, begin, end, points, out); break;
+      case draco::DT_INT64: copy_attribute_rows<int64_t>(att, begin, end, points, out); break;
+      case draco::DT_UINT64: copy_attribute_rows<uint64_t>(att, begin, end, points, out); break;
+      case draco::DT_FLOAT64: copy_attribute_rows<double>(att, begin, end, points, out); break;
+      default: copy_attribute_rows<float>(att, begin, end, points, out); break;
+    }
+  }
+
+  // Writes the values of attributes[index] into |out|, which must have
+  // room for num_points * num_components values of decoded_data_type.
+  void copy_attribute(const MeshObject &meshObject, const int index, void *out) {
+    copy_attribute_range(meshObject, index, 0, meshObject.num_points, out);
+  }
+
+  // Copies the faces into |faces_out| and every attribute i into
+  // attribute_outs[i] on up to |num_threads| threads (<= 0 for one per
+  // core). Null outputs are skipped. Arrays are cut into ranges of rows
+  // handed out dynamically, so that one large attribute is shared
+  // between threads as well.
+  void copy_geometry(const MeshObject &meshObject, uint32_t *faces_out, const std::vector<void*> &attribute_outs, const int num_threads) {
+    const std::size_t range = 65536;
+    struct CopyTask {
+      int index;  // attribute index, -1 for the faces
+      std::size_t begin, end;
+    };
+    std::vector<CopyTask> tasks;
+    if (faces_out) {
+      for (std::size_t begin = 0; begin < meshObject.num_faces; begin += range) {
+        tasks.push_back({ -1, begin, std::min<std::size_t>(meshObject.num_faces, begin + range) });
+      }
+    }
+    for (std::size_t i = 0; i < attribute_outs.size() && i < meshObject.attributes.size(); ++i) {
+      if (!attribute_outs[i]) {
+        continue;
+      }
+      for (std::size_t begin = 0; begin < meshObject.num_points; begin += range) {
+        tasks.push_back({ static_cast<int>(i), begin, std::min<std::size_t>(meshObject.num_points, begin + range) });
+      }
+    }
+
+    parallel_for(tasks.size(), num_threads, [&](std::size_t t) {
+      const CopyTask &task = tasks[t];
+      if (task.index < 0) {
+        copy_face_range(meshObject, task.begin, task.end, faces_out);
+      }
+      else {
+        copy_attribute_range(meshObject, task.index, task.begin, task.end, attribute_outs[task.index]);
+      }
+    });
+  }
+
+  // Frees the decoded geometry once everything needed was copied out.
+  void release_geometry(MeshObject &object) {
+    object.geometry.reset();
+    std::vector<uint32_t>().swap(object.cropped_points);
+    std::vector<uint32_t>().swap(object.cropped_faces);
+  }
+
+  MeshObject decode_buffer(const char *buffer, std::size_t buffer_len, const DecodeOptions &options) {
+    draco::Decoder decoder;
+    configure_decoder(decoder, options);
+    return decode_buffer(decoder, buffer, buffer_len, options);
   }
 
-  void setup_encoder_and_metadata(draco::PointCloud *point_cloud_or_mesh, draco::Encoder &encoder, int compression_level, int quantization_bits, float quantization_range, const float *quantization_origin, bool create_metadata) {
+  MeshObject decode_buffer(const char *buffer, std::size_t buffer_len) {
+    return decode_buffer(buffer, buffer_len, DecodeOptions());
+  }
+
+  // Keeps a draco::Decoder configured for one set of DecodeOptions, so
+  // that a stream of decodes sets it up only once.
+  class DecoderContext {
+   public:
+    explicit DecoderContext(const DecodeOptions &options) : options_(options) {
+      configure_decoder(decoder_, options_);
+    }
+
+    MeshObject decode(const char *buffer, std::size_t buffer_len) {
+      return decode_buffer(decoder_, buffer, buffer_len, options_);
+    }
+
+    const DecodeOptions &options() const { return options_; }
+
+    // Stats collection is toggled per call from Python (process-wide
+    // counters can be enabled after the context was created).
+    void set_collect_stats(bool collect_stats) { options_.collect_stats = collect_stats; }
+    // Likewise the crop box, which usually changes with every call. It
+    // decides whether positions are dequantized, see configure_decoder.
+    void set_bbox(const std::vector<double> &bbox) {
+      const bool was_cropping = !options_.bbox.empty();
+      options_.bbox = bbox;
+      if (was_cropping != !bbox.empty()) {
+        configure_decoder(decoder_, options_);
+      }
+    }
+
+   private:
+    DecodeOptions options_;
+    draco::Decoder decoder_;
+  };
+
+  // Decodes every buffer on a pool of num_threads native threads.
+  // Results are returned in input order.
+  std::vector<MeshObject> decode_buffers(const std::vector<BufferView> &buffers, const DecodeOptions &options, const int num_threads) {
+    std::vector<MeshObject> meshObjects(buffers.size());
+    parallel_for(buffers.size(), num_threads, [&](std::size_t i) {
+      meshObjects[i] = decode_buffer(buffers[i].data, buffers[i].size, options);
+    });
+    return meshObjects;
+  }
+
+  void setup_encoder_and_metadata(draco::PointCloud *point_cloud_or_mesh, draco::ExpertEncoder &encoder, int compression_level, int quantization_bits, float quantization_range, const float *quantization_origin, bool create_metadata) {
+    const int pos_att_id = point_cloud_or_mesh->GetNamedAttributeId(draco::GeometryAttribute::POSITION);
     int speed = 10 - compression_level;
     encoder.SetSpeedOptions(speed, speed);
     // Use existing metadata or create a new one if `create_metadata` is true.
@@ -244,9 +1090,9 @@ namespace DracoFunctions {
     if (quantization_origin == NULL || quantization_range <= 0.f) {
       // @zeruniverse All quantization_range <= 0.f is useless, see
       //    https://github.com/google/draco/blob/master/src/draco/attributes/attribute_quantization_transform.cc#L160-L170
-      encoder.SetAttributeQuantization(draco::GeometryAttribute::POSITION, quantization_bits);
+      encoder.SetAttributeQuantization(pos_att_id, quantization_bits);
     } else {
-      encoder.SetAttributeExplicitQuantization(draco::GeometryAttribute::POSITION, quantization_bits, 3, quantization_origin, quantization_range);
+      encoder.SetAttributeExplicitQuantization(pos_att_id, quantization_bits, 3, quantization_origin, quantization_range);
       if (create_metadata) {
         metadata->AddEntryDouble("quantization_range", quantization_range);
         std::vector<double> quantization_origin_vec;
@@ -256,83 +1102,457 @@ namespace DracoFunctions {
         metadata->AddEntryDoubleArray("quantization_origin", quantization_origin_vec);
       }
     }
-    if (create_metadata) {
-      metadata->AddEntryInt("quantization_bits", quantization_bits);
-    }
+    if (create_metadata) {
+      metadata->AddEntryInt("quantization_bits", quantization_bits);
+    }
+  }
+
+  // The metadata of attribute |att_id|, created if it has none.
+  draco::AttributeMetadata *attribute_metadata(draco::PointCloud &pc, const int att_id) {
+    const int32_t unique_id = pc.attribute(att_id)->unique_id();
+    if (pc.metadata() == nullptr || pc.metadata()->attribute_metadata(unique_id) == nullptr) {
+      pc.AddAttributeMetadata(att_id, std::unique_ptr<draco::AttributeMetadata>(new draco::AttributeMetadata()));
+    }
+    return pc.metadata()->attribute_metadata(unique_id);
+  }
+
+  // Applies the per-attribute settings of |input| to |encoder| and records
+  // them in the attribute metadata of |pc|, so that decode can report them.
+  // The attribute with |internal_unique_id|, one the encoder adds itself
+  // (the point permutation), is left alone.
+  void apply_attribute_options(draco::PointCloud &pc, draco::ExpertEncoder &encoder, const EncodeInput &input, const int internal_unique_id = -1) {
+    for (const AttributeOptions &options : input.attribute_options) {
+      std::vector<int> att_ids;
+      if (options.attribute_type >= 0) {
+        const auto type = static_cast<draco::GeometryAttribute::Type>(options.attribute_type);
+        for (int i = 0; i < pc.NumNamedAttributes(type); ++i) {
+          const int att_id = pc.GetNamedAttributeId(type, i);
+          if (internal_unique_id < 0 || pc.attribute(att_id)->unique_id() != static_cast<uint32_t>(internal_unique_id)) {
+            att_ids.push_back(att_id);
+          }
+        }
+      }
+      else if (options.generic_index >= 0 && options.generic_index < pc.NumNamedAttributes(draco::GeometryAttribute::GENERIC)) {
+        // Generic attributes are the only GENERIC ones and keep the order of attr_data.
+        att_ids.push_back(pc.GetNamedAttributeId(draco::GeometryAttribute::GENERIC, options.generic_index));
+      }
+
+      for (const int att_id : att_ids) {
+        const draco::PointAttribute *att = pc.attribute(att_id);
+        draco::AttributeMetadata *metadata = attribute_metadata(pc, att_id);
+        if (options.quantization_bits >= 0) {
+          if (att->data_type() != draco::DT_FLOAT32) {
+            throw std::invalid_argument("Only float attributes can be quantized.");
+          }
+          if (options.quantization_bits < 1 || options.quantization_bits > 30) {
+            throw std::invalid_argument("Quantization bits must be in range [1, 30].");
+          }
+          const int num_components = att->num_components();
+          if (options.quantization_range > 0.f && static_cast<int>(options.quantization_origin.size()) == num_components) {
+            encoder.SetAttributeExplicitQuantization(att_id, options.quantization_bits, num_components, options.quantization_origin.data(), options.quantization_range);
+            metadata->AddEntryDouble("quantization_range", options.quantization_range);
+            metadata->AddEntryDoubleArray("quantization_origin", std::vector<double>(options.quantization_origin.begin(), options.quantization_origin.end()));
+          }
+          else if (!options.quantization_origin.empty() || options.quantization_range > 0.f) {
+            throw std::invalid_argument("An explicit quantization grid needs a positive range and one origin value per component.");
+          }
+          else {
+            encoder.SetAttributeQuantization(att_id, options.quantization_bits);
+          }
+          metadata->AddEntryInt("quantization_bits", options.quantization_bits);
+        }
+        if (options.prediction_scheme != draco::PREDICTION_UNDEFINED) {
+          const draco::Status status = encoder.SetAttributePredictionScheme(att_id, options.prediction_scheme);
+          if (!status.ok()) {
+            throw std::invalid_argument(status.error_msg_string());
+          }
+          metadata->AddEntryInt("prediction_scheme", options.prediction_scheme);
+        }
+      }
+    }
+  }
+
+  template <typename Dst, typename Src>
+  void convert_values(const Src *src, const std::size_t count, Dst *out) {
+    for (std::size_t i = 0; i < count; ++i) {
+      out[i] = static_cast<Dst>(src[i]);
+    }
+  }
+
+  // Writes every value of |view| into |out| converted to Dst.
+  template <typename Dst>
+  void copy_view_as(const ArrayView &view, Dst *out) {
+    const std::size_t count = view.num_rows * view.num_components;
+    if (view.data_type == DataTypeOf<Dst>::value) {
+      std::memcpy(out, view.data, sizeof(Dst) * count);
+      return;
+    }
+    switch (view.data_type) {
+      case draco::DT_INT8: convert_values(static_cast<const int8_t*>(view.data), count, out); break;
+      case draco::DT_UINT8: convert_values(static_cast<const uint8_t*>(view.data), count, out); break;
+      case draco::DT_INT16: convert_values(static_cast<const int16_t*>(view.data), count, out); break;
+      case draco::DT_UINT16: convert_values(static_cast<const uint16_t*>(view.data), count, out); break;
+      case draco::DT_INT32: convert_values(static_cast<const int32_t*>(view.data), count, out); break;
+      case draco::DT_UINT32: convert_values(static_cast<const uint32_t*>(view.data), count, out); break;
+      case draco::DT_INT64: convert_values(static_cast<const int64_t*>(view.data), count, out); break;
+      case draco::DT_UINT64: convert_values(static_cast<const uint64_t*>(view.data), count, out); break;
+      case draco::DT_FLOAT32: convert_values(static_cast<const float*>(view.data), count, out); break;
+      case draco::DT_FLOAT64: convert_values(static_cast<const double*>(view.data), count, out); break;
+      case draco::DT_BOOL: convert_values(static_cast<const uint8_t*>(view.data), count, out); break;
+      default: throw std::invalid_argument("Unsupported input data type.");
+    }
+  }
+
+  // Writes every value of |view| into |out| converted to |data_type|.
+  void copy_view(const ArrayView &view, const draco::DataType data_type, void *out) {
+    switch (data_type) {
+      case draco::DT_INT8: copy_view_as(view, static_cast<int8_t*>(out)); break;
+      case draco::DT_UINT8: copy_view_as(view, static_cast<uint8_t*>(out)); break;
+      case draco::DT_INT16: copy_view_as(view, static_cast<int16_t*>(out)); break;
+      case draco::DT_UINT16: copy_view_as(view, static_cast<uint16_t*>(out)); break;
+      case draco::DT_INT32: copy_view_as(view, static_cast<int32_t*>(out)); break;
+      case draco::DT_UINT32: copy_view_as(view, static_cast<uint32_t*>(out)); break;
+      case draco::DT_INT64: copy_view_as(view, static_cast<int64_t*>(out)); break;
+      case draco::DT_UINT64: copy_view_as(view, static_cast<uint64_t*>(out)); break;
+      case draco::DT_FLOAT32: copy_view_as(view, static_cast<float*>(out)); break;
+      case draco::DT_FLOAT64: copy_view_as(view, static_cast<double*>(out)); break;
+      case draco::DT_BOOL: copy_view_as(view, static_cast<uint8_t*>(out)); break;
+      default: throw std::invalid_argument("Unsupported attribute data type.");
+    }
+  }
+
+  // Returns the values of |view| stored as |data_type|. The input is
+  // used in place when it already has that type, otherwise it is
+  // converted once into |scratch|.
+  const uint8_t *view_values_as(const ArrayView &view, const draco::DataType data_type, std::vector<uint8_t> &scratch) {
+    if (view.data_type == data_type) {
+      return static_cast<const uint8_t*>(view.data);
+    }
+    scratch.resize(view.num_rows * view.num_components * draco::DataTypeLength(data_type));
+    copy_view(view, data_type, scratch.data());
+    return scratch.data();
+  }
+
+  // Integer positions are encoded as 32 bit integers, everything else as
+  // float so that it can be quantized.
+  draco::DataType position_data_type(const int data_type) {
+    switch (data_type) {
+      case draco::DT_INT8:
+      case draco::DT_INT16:
+      case draco::DT_INT32:
+      case draco::DT_INT64:
+        return draco::DT_INT32;
+      case draco::DT_UINT8:
+      case draco::DT_UINT16:
+      case draco::DT_UINT32:
+      case draco::DT_UINT64:
+        return draco::DT_UINT32;
+      default:
+        return draco::DT_FLOAT32;
+    }
+  }
+
+  // Generic attributes keep their input type, except that doubles are
+  // stored as float so that they can be quantized.
+  draco::DataType generic_data_type(const int data_type) {
+    if (data_type <= draco::DT_INVALID || data_type >= draco::DT_TYPES_COUNT) {
+      return draco::DT_INVALID;
+    }
+    if (data_type == draco::DT_FLOAT64) {
+      return draco::DT_FLOAT32;
+    }
+    return static_cast<draco::DataType>(data_type);
+  }
+
+  // Ensure unique ids for native attributes don't conflict with generic attributes
+  uint32_t first_free_unique_id(const std::vector<int8_t> &unique_ids) {
+    auto min_unique_id = std::min_element(unique_ids.begin(), unique_ids.end());
+    if (min_unique_id != unique_ids.end() && *min_unique_id < -1) {
+      throw std::invalid_argument("Should never be reached; all unique_ids should be >= -1.");
+    }
+    auto max_unique_id = std::max_element(unique_ids.begin(), unique_ids.end());
+    if (max_unique_id != unique_ids.end()) {
+      return *max_unique_id + 1;
+    }
+    return 0;
+  }
+
+  // Copies the rows |rows| of |view| into |storage| and returns a view of
+  // the copy.
+  ArrayView gather_rows(const ArrayView &view, const std::vector<uint32_t> &rows, std::vector<uint8_t> &storage) {
+    const std::size_t row_size = draco::DataTypeLength(static_cast<draco::DataType>(view.data_type)) * view.num_components;
+    storage.resize(rows.size() * row_size);
+    const uint8_t *src = static_cast<const uint8_t*>(view.data);
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+      std::memcpy(storage.data() + i * row_size, src + static_cast<std::size_t>(rows[i]) * row_size, row_size);
+    }
+    ArrayView gathered = view;
+    gathered.data = storage.data();
+    gathered.num_rows = rows.size();
+    return gathered;
+  }
+
+  // A subset of the faces of a parent EncodeInput: a simplified level of
+  // detail or a spatial partition. Its views point into |storage|, which
+  // holds the parent vertices used by |faces| renumbered in order of
+  // first use.
+  struct LevelInput {
+    EncodeInput input;
+    std::vector<uint32_t> faces;
+    std::vector<std::vector<uint8_t>> storage;
+
+    LevelInput(const EncodeInput &parent, std::vector<uint32_t> level_faces)
+        : input(parent), faces(std::move(level_faces)), storage(5 + parent.attr_data.size()) {
+      std::vector<uint32_t> remap(parent.points.num_rows, std::numeric_limits<uint32_t>::max());
+      std::vector<uint32_t> rows;
+      for (uint32_t &v : faces) {
+        if (remap[v] == std::numeric_limits<uint32_t>::max()) {
+          remap[v] = static_cast<uint32_t>(rows.size());
+          rows.push_back(v);
+        }
+        v = remap[v];
+      }
+
+      input.points = gather_rows(parent.points, rows, storage[0]);
+      if (parent.colors.num_components) {
+        input.colors = gather_rows(parent.colors, rows, storage[1]);
+      }
+      if (parent.tex_coord.num_components) {
+        input.tex_coord = gather_rows(parent.tex_coord, rows, storage[2]);
+      }
+      if (parent.normals.num_components) {
+        input.normals = gather_rows(parent.normals, rows, storage[3]);
+      }
+      for (std::size_t i = 0; i < parent.attr_data.size(); ++i) {
+        input.attr_data[i] = gather_rows(parent.attr_data[i], rows, storage[5 + i]);
+      }
+      input.faces.data = faces.data();
+      input.faces.num_rows = faces.size() / 3;
+      input.faces.num_components = 3;
+      input.faces.data_type = draco::DT_UINT32;
+    }
+  };
+
+  // Sorts |values| with |less| on up to |num_threads| threads: slices
+  // are sorted concurrently, then merged pairwise.
+  template <typename T, typename Less>
+  void parallel_sort(std::vector<T> &values, int num_threads, const Less &less) {
+    if (num_threads <= 0) {
+      num_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    const std::size_t n = values.size();
+    const std::size_t num_slices = std::min(static_cast<std::size_t>(num_threads), n / 65536 + 1);
+    if (num_slices <= 1) {
+      std::sort(values.begin(), values.end(), less);
+      return;
+    }
+    std::vector<std::size_t> bounds(num_slices + 1);
+    for (std::size_t i = 0; i <= num_slices; ++i) {
+      bounds[i] = n * i / num_slices;
+    }
+    parallel_for(num_slices, num_threads, [&](std::size_t i) {
+      std::sort(values.begin() + bounds[i], values.begin() + bounds[i + 1], less);
+    });
+    for (std::size_t width = 1; width < num_slices; width *= 2) {
+      const std::size_t num_merges = (num_slices - width + 2 * width - 1) / (2 * width);
+      parallel_for(num_merges, num_threads, [&](std::size_t k) {
+        const std::size_t first = 2 * width * k;
+        const std::size_t last = std::min(first + 2 * width, num_slices);
+        std::inplace_merge(values.begin() + bounds[first], values.begin() + bounds[first + width], values.begin() + bounds[last], less);
+      });
+    }
+  }
+
+  // Runs fn(begin, end) over consecutive blocks of [0, n) in parallel.
+  template <typename F>
+  void parallel_blocks(const std::size_t n, const int num_threads, const F &fn) {
+    const std::size_t block = 65536;
+    parallel_for((n + block - 1) / block, num_threads, [&](std::size_t b) {
+      fn(b * block, std::min(n, (b + 1) * block));
+    });
+  }
+
+  // One attribute of the vertices being welded, row by row, as it will be
+  // stored in the draco geometry (positions possibly as grid indices).
+  struct WeldColumn {
+    const uint8_t *values;
+    std::size_t row_size;
+  };
+
+  // Merges the vertices of the mesh |input| whose attribute values all
+  // match, comparing positions on the quantization grid with
+  // weld_quantized, and returns its faces pointing at the first vertex of
+  // each group. Vertices are grouped by sorting a hash of their values in
+  // parallel; equal hashes are confirmed by comparing the values. With
+  // weld_quantized, the grid Draco would derive from the positions is
+  // made explicit in |input|, so that the welded mesh quantizes on it too.
+  std::vector<uint32_t> weld_faces(EncodeInput &input, std::size_t &num_welded) {
+    const std::size_t num_points = input.points.num_rows;
+    const int num_threads = input.num_threads;
+    std::vector<std::vector<uint8_t>> scratch(5 + input.attr_data.size());
+    std::vector<WeldColumn> columns;
+
+    const draco::DataType position_dtype = position_data_type(input.points.data_type);
+    std::vector<int32_t> grid;
+    if (input.weld == weld_quantized && position_dtype == draco::DT_FLOAT32 && input.quantization_bits > 0) {
+      const float *positions = reinterpret_cast<const float*>(view_values_as(input.points, draco::DT_FLOAT32, scratch[0]));
+      float lo[3] = { 0, 0, 0 }, hi[3] = { 0, 0, 0 };
+      for (std::size_t i = 0; i < num_points; ++i) {
+        for (int axis = 0; axis < 3; ++axis) {
+          lo[axis] = (i == 0) ? positions[3 * i + axis] : std::min(lo[axis], positions[3 * i + axis]);
+          hi[axis] = (i == 0) ? positions[3 * i + axis] : std::max(hi[axis], positions[3 * i + axis]);
+        }
+      }
+      if (input.quantization_origin.size() < 3 || input.quantization_range <= 0.f) {
+        if (input.quantization_origin.size() < 3) {
+          input.quantization_origin.assign(lo, lo + 3);
+        }
+        float range = 0.f;
+        for (int axis = 0; axis < 3; ++axis) {
+          range = std::max(range, hi[axis] - input.quantization_origin[axis]);
+        }
+        input.quantization_range = range > 0.f ? range : 1.f;
+      }
+      // Same float arithmetic as draco::Quantizer.
+      const float inverse_delta = static_cast<float>((1u << input.quantization_bits) - 1) / input.quantization_range;
+      const float *origin = input.quantization_origin.data();
+      grid.resize(num_points * 3);
+      parallel_blocks(num_points, num_threads, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = 3 * begin; i < 3 * end; ++i) {
+          grid[i] = static_cast<int32_t>(std::floor((positions[i] - origin[i % 3]) * inverse_delta + 0.5f));
+        }
+      });
+      columns.push_back({ reinterpret_cast<const uint8_t*>(grid.data()), 3 * sizeof(int32_t) });
+    }
+    else {
+      columns.push_back({ view_values_as(input.points, position_dtype, scratch[0]), 3 * draco::DataTypeLength(position_dtype) });
+    }
+    if (input.colors.num_components) {
+      columns.push_back({ view_values_as(input.colors, draco::DT_UINT8, scratch[1]), static_cast<std::size_t>(input.colors.num_components) });
+    }
+    if (input.tex_coord.num_components) {
+      columns.push_back({ view_values_as(input.tex_coord, draco::DT_FLOAT32, scratch[2]), sizeof(float) * input.tex_coord.num_components });
+    }
+    if (input.normals.num_components) {
+      columns.push_back({ view_values_as(input.normals, draco::DT_FLOAT32, scratch[3]), sizeof(float) * input.normals.num_components });
+    }
+    for (std::size_t i = 0; i < input.attr_data.size(); ++i) {
+      const draco::DataType dtype = generic_data_type(input.attr_data[i].data_type);
+      if (dtype == draco::DT_INVALID) {
+        throw std::invalid_argument("Unsupported attribute data type.");
+      }
+      columns.push_back({ view_values_as(input.attr_data[i], dtype, scratch[5 + i]), draco::DataTypeLength(dtype) * input.attr_data[i].num_components });
+    }
+
+    // FNV-1a over every value of a vertex, paired with its index so that
+    // the first vertex of each group sorts first.
+    std::vector<std::pair<uint64_t, uint32_t>> order(num_points);
+    parallel_blocks(num_points, num_threads, [&](std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) {
+        uint64_t hash = 14695981039346656037ull;
+        for (const WeldColumn &column : columns) {
+          const uint8_t *row = column.values + i * column.row_size;
+          for (std::size_t k = 0; k < column.row_size; ++k) {
+            hash = (hash ^ row[k]) * 1099511628211ull;
+          }
+        }
+        order[i] = std::make_pair(hash, static_cast<uint32_t>(i));
+      }
+    });
+    parallel_sort(order, num_threads, std::less<std::pair<uint64_t, uint32_t>>());
+
+    auto same = [&](uint32_t a, uint32_t b) {
+      for (const WeldColumn &column : columns) {
+        if (std::memcmp(column.values + a * column.row_size, column.values + b * column.row_size, column.row_size) != 0) {
+          return false;
+        }
+      }
+      return true;
+    };
+    std::vector<uint32_t> representative(num_points);
+    std::vector<uint32_t> candidates;
+    num_welded = 0;
+    for (std::size_t run = 0; run < num_points;) {
+      std::size_t end = run + 1;
+      while (end < num_points && order[end].first == order[run].first) {
+        ++end;
+      }
+      candidates.clear();
+      for (std::size_t k = run; k < end; ++k) {
+        const uint32_t v = order[k].second;
+        representative[v] = v;
+        for (const uint32_t candidate : candidates) {
+          if (same(candidate, v)) {
+            representative[v] = candidate;
+            ++num_welded;
+            break;
+          }
+        }
+        if (representative[v] == v) {
+          candidates.push_back(v);
+        }
+      }
+      run = end;
+    }
+
+    std::vector<uint32_t> faces(input.faces.num_rows * 3);
+    copy_view_as(input.faces, faces.data());
+    parallel_blocks(faces.size(), num_threads, [&](std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) {
+        if (faces[i] >= num_points) {
+          throw std::invalid_argument("Faces reference vertices that do not exist.");
+        }
+        faces[i] = representative[faces[i]];
+      }
+    });
+    return faces;
   }
 
-  EncodedObject encode_mesh(
-    const std::vector<float> &points,
-    const std::vector<unsigned int> &faces,
-    const int quantization_bits,
-    const int compression_level,
-    const float quantization_range,
-    const float *quantization_origin,
-    const bool preserve_order,
-    const bool create_metadata,
-    const int integer_mark,
-    const std::vector<uint8_t> &colors,
-    const uint8_t colors_channel,
-    const std::vector<float> &tex_coord,
-    const uint8_t tex_coord_channel,
-    const std::vector<float> &normals,
-    const uint8_t has_normals,
-    std::vector<int8_t>& unique_ids,
-    std::vector<std::vector<float>>& attr_float_data,
-    std::vector<std::vector<uint8_t>>& attr_uint8_data,
-    std::vector<std::vector<uint16_t>>& attr_uint16_data,
-    std::vector<std::vector<uint32_t>>& attr_uint32_data,
-    std::vector<int>& attr_data_types,
-    std::vector<int>& attr_num_components,
-    std::vector<std::string>& attr_names
-  ) {
+  // Encodes |input| as a mesh, appending the result to |buffer|. Stage
+  // stats are recorded in |stats| when given.
+  encoding_status encode_mesh(const EncodeInput &input, draco::EncoderBuffer &buffer, NativeStats *stats = nullptr) {
+    StageClock clock(stats);
+    if (!input.preserve_order && (input.weld == weld_exact || input.weld == weld_quantized)) {
+      // Welded vertices are gathered in order of first use by the faces,
+      // which also drops the vertices no face uses.
+      EncodeInput parent = input;
+      std::size_t num_welded = 0;
+      std::vector<uint32_t> faces = weld_faces(parent, num_welded);
+      LevelInput welded(parent, std::move(faces));
+      welded.input.weld = weld_none;
+      clock.lap(&NativeStats::build);
+      if (stats) {
+        stats->welded_vertices = num_welded;
+      }
+      return encode_mesh(welded.input, buffer, stats);
+    }
     // @zeruniverse TriangleSoupMeshBuilder will cause problems when
     //    preserve_order=True due to vertices merging.
     //    In order to support preserve_order, we need to build mesh
     //    manually.
     draco::Mesh mesh; //Initialize a draco mesh
 
-    // Ensure unique ids for native attributes don't conflict with generic attributes
-    uint32_t next_unique_id = 0;
-    auto min_unique_id = std::min_element(unique_ids.begin(), unique_ids.end());
-    if (min_unique_id != unique_ids.end() && *min_unique_id < -1) {
-      throw std::invalid_argument("Should never be reached; all unique_ids should be >= -1.");
-    }
-    auto max_unique_id = std::max_element(unique_ids.begin(), unique_ids.end());
-    if (max_unique_id != unique_ids.end()) {
-      next_unique_id = *max_unique_id + 1;
-    }
+    const std::vector<int8_t> &unique_ids = input.unique_ids;
+    uint32_t next_unique_id = first_free_unique_id(unique_ids);
+
+    // Attribute values are converted straight into each attribute's
+    // buffer from these sources once all attributes have been added.
+    std::vector<std::pair<int, const ArrayView*>> sources;
 
     // Process vertices
-    const size_t num_pts = points.size() / 3;
+    const size_t num_pts = input.points.num_rows;
     mesh.set_num_points(num_pts);
+    const draco::DataType position_dtype = position_data_type(input.points.data_type);
     draco::GeometryAttribute positions_attr;
-    if (integer_mark == 1) {
-      positions_attr.Init(draco::GeometryAttribute::POSITION, // Attribute type
-                          nullptr,                            // data buffer
-                          3,                                  // number of components
-                          draco::DT_INT32,                    // data type
-                          false,                              // normalized
-                          sizeof(int32_t) * 3,                // byte stride
-                          0);                                 // byte offset
-    } else if (integer_mark == 2) {
-      positions_attr.Init(draco::GeometryAttribute::POSITION, // Attribute type
-                          nullptr,                            // data buffer
-                          3,                                  // number of components
-                          draco::DT_UINT32,                   // data type
-                          false,                              // normalized
-                          sizeof(uint32_t) * 3,               // byte stride
-                          0);                                 // byte offset
-    } else {
-      positions_attr.Init(draco::GeometryAttribute::POSITION, // Attribute type
-                          nullptr,                            // data buffer
-                          3,                                  // number of components
-                          draco::DT_FLOAT32,                  // data type
-                          false,                              // normalized
-                          sizeof(float) * 3,                  // byte stride
-                          0);                                 // byte offset
-    }
-    int color_att_id = -1;
+    positions_attr.Init(draco::GeometryAttribute::POSITION,     // Attribute type
+                        nullptr,                                // data buffer
+                        3,                                      // number of components
+                        position_dtype,                         // data type
+                        false,                                  // normalized
+                        draco::DataTypeLength(position_dtype) * 3, // byte stride
+                        0);                                     // byte offset
+
+    const uint8_t colors_channel = input.colors.num_components;
     if(colors_channel) {
       draco::GeometryAttribute colors_attr;
       colors_attr.Init(draco::GeometryAttribute::COLOR,    // Attribute type
@@ -342,11 +1562,12 @@ namespace DracoFunctions {
                        true,                               // normalized
                        sizeof(uint8_t) * colors_channel,   // byte stride
                        0);                                 // byte offset
-      color_att_id = mesh.AddAttribute(colors_attr, true, num_pts);
+      const int color_att_id = mesh.AddAttribute(colors_attr, true, num_pts);
       mesh.attribute(color_att_id)->set_unique_id(next_unique_id);
       next_unique_id++;
+      sources.emplace_back(color_att_id, &input.colors);
     }
-    int tex_coord_att_id = -1;
+    const uint8_t tex_coord_channel = input.tex_coord.num_components;
     if(tex_coord_channel) {
       draco::GeometryAttribute tex_coord_attr;
       tex_coord_attr.Init(draco::GeometryAttribute::TEX_COORD, // Attribute type
@@ -356,13 +1577,13 @@ namespace DracoFunctions {
                           true,                                // normalized
                           sizeof(float) * tex_coord_channel,   // byte stride
                           0);                                  // byte offset
-      tex_coord_att_id = mesh.AddAttribute(tex_coord_attr, true, num_pts);
+      const int tex_coord_att_id = mesh.AddAttribute(tex_coord_attr, true, num_pts);
       mesh.attribute(tex_coord_att_id)->set_unique_id(next_unique_id);
       next_unique_id++;
+      sources.emplace_back(tex_coord_att_id, &input.tex_coord);
     }
 
-    int normal_att_id = -1;
-    if(has_normals) {
+    if(input.normals.num_components) {
       draco::GeometryAttribute normal_attr;
       normal_attr.Init(draco::GeometryAttribute::NORMAL,    // Attribute type
                        nullptr,                             // data buffer
@@ -371,22 +1592,21 @@ namespace DracoFunctions {
                        false,                               // normalized
                        sizeof(float) * 3,                   // byte stride
                        0);                                  // byte offset
-      normal_att_id = mesh.AddAttribute(normal_attr, true, num_pts);
+      const int normal_att_id = mesh.AddAttribute(normal_attr, true, num_pts);
       mesh.attribute(normal_att_id)->set_unique_id(next_unique_id);
       next_unique_id++;
+      sources.emplace_back(normal_att_id, &input.normals);
     }
 
 
 
     // GENERIC ATTRIBUTES
-    std::vector<int> generic_attr_ids;
-    generic_attr_ids.reserve(unique_ids.size());
-
     for (size_t i = 0; i < unique_ids.size(); ++i) {
       draco::GeometryAttribute generic_attr;
-      draco::DataType dtype = static_cast<draco::DataType>(attr_data_types[i]);
-      int num_components = attr_num_components[i];
-      if (dtype != draco::DT_FLOAT32 && dtype != draco::DT_UINT8 && dtype != draco::DT_UINT16 && dtype != draco::DT_UINT32) {
+      const ArrayView &values = input.attr_data[i];
+      draco::DataType dtype = generic_data_type(values.data_type);
+      int num_components = values.num_components;
+      if (dtype == draco::DT_INVALID) {
         std::ostringstream oss;
         oss << "Unsupported attribute data type for attribute with unique id " << int(unique_ids[i]);
         throw std::invalid_argument(oss.str());
@@ -404,182 +1624,248 @@ namespace DracoFunctions {
         mesh.attribute(att_id)->set_unique_id(next_unique_id);
         next_unique_id++;
       }
-      if (!attr_names[i].empty()) {
+      if (!input.attr_names[i].empty()) {
         auto attribute_metadata = std::unique_ptr<draco::AttributeMetadata>(new draco::AttributeMetadata());
-        attribute_metadata->AddEntryString("name", attr_names[i]);
+        attribute_metadata->AddEntryString("name", input.attr_names[i]);
         mesh.AddAttributeMetadata(att_id, std::move(attribute_metadata));
       }
 
-      generic_attr_ids.push_back(att_id);
+      sources.emplace_back(att_id, &values);
     }
 
 
     const int pos_att_id = mesh.AddAttribute(positions_attr, true, num_pts);
     mesh.attribute(pos_att_id)->set_unique_id(next_unique_id);
     next_unique_id++;
-    std::vector<int32_t> pts_int32;
-    std::vector<uint32_t> pts_uint32;
-    if (integer_mark == 1) {
-      pts_int32.reserve(points.size());
-      std::transform(points.begin(), points.end(), std::back_inserter(pts_int32), [](float x) {
-        return lrint(x);
-      });
-    } else if (integer_mark == 2) {
-      pts_uint32.reserve(points.size());
-      std::transform(points.begin(), points.end(), std::back_inserter(pts_uint32), [](float x) {
-        return (x <= 0.f)? 0: (uint32_t)(x + 0.5);
-      });
-    }
-
-
-    for (size_t i = 0; i < num_pts; ++i) {
-      if (integer_mark == 1) {
-        mesh.attribute(pos_att_id)->SetAttributeValue(draco::AttributeValueIndex(i), &pts_int32[i * 3ul]);
-      } else if (integer_mark == 2) {
-        mesh.attribute(pos_att_id)->SetAttributeValue(draco::AttributeValueIndex(i), &pts_uint32[i * 3ul]);
-      } else {
-        mesh.attribute(pos_att_id)->SetAttributeValue(draco::AttributeValueIndex(i), &points[i * 3ul]);
-      }
-
-      if(colors_channel){
-        mesh.attribute(color_att_id)->SetAttributeValue(draco::AttributeValueIndex(i), &colors[i * colors_channel]);
-      }
-      if(tex_coord_channel){
-        mesh.attribute(tex_coord_att_id)->SetAttributeValue(draco::AttributeValueIndex(i), &tex_coord[i * tex_coord_channel]);
-      }
-      if(has_normals){
-        mesh.attribute(normal_att_id)->SetAttributeValue(draco::AttributeValueIndex(i), &normals[i * 3]);
-      }
-
-
-      // GENERIC ATTRIBUTES
-      for (size_t j = 0; j < generic_attr_ids.size(); ++j) {
-        const auto &float_data = attr_float_data[j];
-        const auto &uint8_data = attr_uint8_data[j];
-        const auto &uint16_data = attr_uint16_data[j];
-        const auto &uint32_data = attr_uint32_data[j];
+    sources.emplace_back(pos_att_id, &input.points);
 
-        if (generic_attr_ids[j] == -1) {
-          throw std::runtime_error("Should never be reached; all successfully added attributes should have nonnegative att_id.");
-        } 
-
-        if (attr_data_types[j] == draco::DT_FLOAT32) {
-          mesh.attribute(generic_attr_ids[j])->SetAttributeValue(draco::AttributeValueIndex(i), &float_data[i * attr_num_components[j]]);
-        } else if (attr_data_types[j] == draco::DT_UINT8) {
-          mesh.attribute(generic_attr_ids[j])->SetAttributeValue(draco::AttributeValueIndex(i), &uint8_data[i * attr_num_components[j]]);
-        } else if (attr_data_types[j] == draco::DT_UINT16) {
-          mesh.attribute(generic_attr_ids[j])->SetAttributeValue(draco::AttributeValueIndex(i), &uint16_data[i * attr_num_components[j]]);
-        } else if (attr_data_types[j] == draco::DT_UINT32) {
-          mesh.attribute(generic_attr_ids[j])->SetAttributeValue(draco::AttributeValueIndex(i), &uint32_data[i * attr_num_components[j]]);
+    // Every attribute was added with identity mapping and num_pts values,
+    // so its buffer is one packed array that can be filled in one pass.
+    if (num_pts > 0) {
+      for (const auto &source : sources) {
+        draco::PointAttribute *att = mesh.attribute(source.first);
+        if (source.second->num_rows != num_pts) {
+          throw std::invalid_argument("Every attribute must have one row per point.");
         }
+        copy_view(*source.second, att->data_type(), att->GetAddress(draco::AttributeValueIndex(0)));
       }
     }
 
-    const size_t num_faces = faces.size() / 3;
+    // Faces are converted in one pass, then handed to the mesh, whose
+    // face array is sized once.
+    const size_t num_faces = input.faces.num_rows;
+    std::vector<uint32_t> faces(num_faces * 3);
+    copy_view_as(input.faces, faces.data());
+    mesh.SetNumFaces(num_faces);
+    draco::Mesh::Face face;
     for (size_t i = 0; i < num_faces; ++i) {
-      mesh.AddFace(
-          draco::Mesh::Face{draco::PointIndex(faces[3 * i]),
-                            draco::PointIndex(faces[3 * i + 1]),
-                            draco::PointIndex(faces[3 * i + 2])});
+      for (int c = 0; c < 3; ++c) {
+        if (faces[3 * i + c] >= num_pts) {
+          throw std::invalid_argument("Faces reference vertices that do not exist.");
+        }
+        face[c] = faces[3 * i + c];
+      }
+      mesh.SetFace(draco::FaceIndex(i), face);
     }
 
     // deduplicate
-    if (!preserve_order && mesh.DeduplicateAttributeValues()) {
+    if (!input.preserve_order && input.weld == weld_draco && mesh.DeduplicateAttributeValues()) {
       mesh.DeduplicatePointIds();
     }
+    clock.lap(&NativeStats::build);
+    if (stats) {
+      stats->native_bytes = geometry_bytes(mesh, mesh.num_faces());
+    }
 
-    draco::Encoder encoder;
+    // draco::Encoder would hand its per-type settings to an ExpertEncoder;
+    // using one directly also allows settings per attribute.
+    draco::ExpertEncoder encoder(mesh);
     setup_encoder_and_metadata(
-      &mesh, encoder, compression_level,
-      quantization_bits, quantization_range,
-      quantization_origin, create_metadata
+      &mesh, encoder, input.compression_level,
+      input.quantization_bits, input.quantization_range,
+      input.quantization_origin.empty() ? NULL : input.quantization_origin.data(),
+      input.create_metadata
     );
-    if (preserve_order) {
+    apply_attribute_options(mesh, encoder, input);
+    if (input.preserve_order) {
       encoder.SetEncodingMethod(draco::MESH_SEQUENTIAL_ENCODING);
     }
 
+    const draco::Status status = encoder.EncodeToBuffer(&buffer);
+    clock.lap(&NativeStats::draco);
+    if (!status.ok()) {
+      std::cerr << "Draco encoding error: " << status.error_msg_string() << std::endl;
+      return failed_during_encoding;
+    }
+    return successful_encoding;
+  }
+
+  // Copies the encoded bytes of |buffer| into |out|.
+  void copy_buffer(const draco::EncoderBuffer &buffer, std::vector<char> &out) {
+    out.assign(buffer.data(), buffer.data() + buffer.size());
+  }
+
+  EncodedObject encode_mesh(const EncodeInput &input) {
     draco::EncoderBuffer buffer;
-    const draco::Status status = encoder.EncodeMeshToBuffer(mesh, &buffer);
     EncodedObject encodedMeshObject;
-    encodedMeshObject.buffer = *((std::vector<unsigned char> *)buffer.buffer());
+    encodedMeshObject.encode_status = encode_mesh(input, buffer, input.collect_stats ? &encodedMeshObject.stats : nullptr);
+    copy_buffer(buffer, encodedMeshObject.buffer);
+    return encodedMeshObject;
+  }
 
-    if (status.ok()) {
-      encodedMeshObject.encode_status = successful_encoding;
+  // Bounding box of the xyz rows of |positions|; zero when empty.
+  void position_bounds(const std::vector<double> &positions, double lo[3], double hi[3]) {
+    for (int axis = 0; axis < 3; ++axis) {
+      lo[axis] = hi[axis] = 0;
     }
-    else {
-      std::cerr << "Draco encoding error: " << status.error_msg_string() << std::endl;
-      encodedMeshObject.encode_status = failed_during_encoding;
+    for (std::size_t i = 0; i < positions.size() / 3; ++i) {
+      for (int axis = 0; axis < 3; ++axis) {
+        const double value = positions[3 * i + axis];
+        lo[axis] = (i == 0) ? value : std::min(lo[axis], value);
+        hi[axis] = (i == 0) ? value : std::max(hi[axis], value);
+      }
+    }
+  }
+
+  // Spreads the low 21 bits of |v| out to every third bit.
+  inline uint64_t spread_bits(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffull;
+    v = (v | v << 16) & 0x1f0000ff0000ffull;
+    v = (v | v << 8) & 0x100f00f00f00f00full;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+  }
+
+  // Index of a cell of a 2^21 cubed grid along the Z-order curve.
+  inline uint64_t morton_key(const uint32_t cell[3]) {
+    return spread_bits(cell[0]) << 2 | spread_bits(cell[1]) << 1 | spread_bits(cell[2]);
+  }
+
+  // Index of a cell of a 2^21 cubed grid along the Hilbert curve.
+  // Skilling's transform ("Programming the Hilbert curve", 2004) turns
+  // the cell into the transposed index, whose bits interleave like a
+  // Morton key.
+  inline uint64_t hilbert_key(const uint32_t cell[3]) {
+    uint32_t x[3] = { cell[0], cell[1], cell[2] };
+    const uint32_t top = 1u << 20;
+    for (uint32_t q = top; q > 1; q >>= 1) {
+      const uint32_t p = q - 1;
+      for (int i = 0; i < 3; ++i) {
+        if (x[i] & q) {
+          x[0] ^= p;
+        }
+        else {
+          const uint32_t t = (x[0] ^ x[i]) & p;
+          x[0] ^= t;
+          x[i] ^= t;
+        }
+      }
+    }
+    x[1] ^= x[0];
+    x[2] ^= x[1];
+    uint32_t t = 0;
+    for (uint32_t q = top; q > 1; q >>= 1) {
+      if (x[2] & q) {
+        t ^= q - 1;
+      }
+    }
+    for (int i = 0; i < 3; ++i) {
+      x[i] ^= t;
     }
+    return morton_key(x);
+  }
 
-    return encodedMeshObject;
+  // The input indices of the points of |view| in the order of the curve
+  // |mode| through a 2^21 cubed grid over their bounding box. Keys are
+  // computed and sorted in parallel; points in one cell keep their order.
+  std::vector<uint32_t> spatial_order(const ArrayView &view, const int mode, const int num_threads) {
+    const std::size_t num_points = view.num_rows;
+    std::vector<double> positions(num_points * 3);
+    copy_view_as(view, positions.data());
+    double lo[3], hi[3];
+    position_bounds(positions, lo, hi);
+    double scale[3];
+    for (int axis = 0; axis < 3; ++axis) {
+      scale[axis] = hi[axis] > lo[axis] ? ((1u << 21) - 1) / (hi[axis] - lo[axis]) : 0.0;
+    }
+
+    std::vector<std::pair<uint64_t, uint32_t>> keys(num_points);
+    parallel_blocks(num_points, num_threads, [&](std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) {
+        uint32_t cell[3];
+        for (int axis = 0; axis < 3; ++axis) {
+          cell[axis] = static_cast<uint32_t>((positions[3 * i + axis] - lo[axis]) * scale[axis]);
+        }
+        const uint64_t key = mode == order_hilbert ? hilbert_key(cell) : morton_key(cell);
+        keys[i] = std::make_pair(key, static_cast<uint32_t>(i));
+      }
+    });
+    parallel_sort(keys, num_threads, std::less<std::pair<uint64_t, uint32_t>>());
+
+    std::vector<uint32_t> order(num_points);
+    for (std::size_t i = 0; i < num_points; ++i) {
+      order[i] = keys[i].second;
+    }
+    return order;
   }
 
-  EncodedObject encode_point_cloud(
-    const std::vector<float> &points, const int quantization_bits,
-    const int compression_level, const float quantization_range,
-    const float *quantization_origin, const bool preserve_order,
-    const bool create_metadata, const int integer_mark,
-    const std::vector<uint8_t> &colors,
-    const uint8_t colors_channel,
-    std::vector<int8_t>& unique_ids,
-    std::vector<std::vector<float>>& attr_float_data,
-    std::vector<std::vector<uint8_t>>& attr_uint8_data,
-    std::vector<std::vector<uint16_t>>& attr_uint16_data,
-    std::vector<std::vector<uint32_t>>& attr_uint32_data,
-    std::vector<int>& attr_data_types,
-    std::vector<int>& attr_num_components,
-    std::vector<std::string>& attr_names
-  ) {
-    int num_points = points.size() / 3;
+  // Encodes |input| as a point cloud, appending the result to |buffer|.
+  // Stats are recorded in |stats| when given.
+  encoding_status encode_point_cloud(const EncodeInput &input, draco::EncoderBuffer &buffer, NativeStats *stats = nullptr) {
+    StageClock clock(stats);
+    int num_points = input.points.num_rows;
     draco::PointCloudBuilder pcb;
     pcb.Start(num_points);
 
-    // Ensure unique ids for native attributes don't conflict with generic attributes
-    uint32_t next_unique_id = 0;
-    auto min_unique_id = std::min_element(unique_ids.begin(), unique_ids.end());
-    if (min_unique_id != unique_ids.end() && *min_unique_id < -1) {
-      throw std::invalid_argument("Should never be reached; all unique_ids should be >= -1.");
+    // Sorted points are built from gathered copies of the input rows.
+    std::vector<uint32_t> order;
+    if (input.point_order != order_input) {
+      order = spatial_order(input.points, input.point_order, input.num_threads);
     }
-    auto max_unique_id = std::max_element(unique_ids.begin(), unique_ids.end());
-    if (max_unique_id != unique_ids.end()) {
-      next_unique_id = *max_unique_id + 1;
+    else if (input.store_permutation) {
+      order.resize(num_points);
+      for (int i = 0; i < num_points; ++i) {
+        order[i] = i;
+      }
     }
+    const bool sorted = input.point_order != order_input;
+    std::vector<std::vector<uint8_t>> gathered(2 + input.attr_data.size());
+    auto rows = [&](const ArrayView &view, std::vector<uint8_t> &storage) {
+      return sorted ? gather_rows(view, order, storage) : view;
+    };
 
-    auto dtype = (integer_mark == 1)
-      ? draco::DataType::DT_INT32
-      : (
-        (integer_mark == 2)
-          ? draco::DataType::DT_UINT32
-          : draco::DataType::DT_FLOAT32
-      );
+    const std::vector<int8_t> &unique_ids = input.unique_ids;
+    uint32_t next_unique_id = first_free_unique_id(unique_ids);
+
+    auto dtype = position_data_type(input.points.data_type);
 
     const int pos_att_id = pcb.AddAttribute(
       draco::GeometryAttribute::POSITION, 3, dtype
     );
     pcb.SetAttributeUniqueId(pos_att_id, next_unique_id);
     next_unique_id++;
+    std::vector<uint8_t> position_scratch;
+    pcb.SetAttributeValuesForAllPoints(pos_att_id, view_values_as(rows(input.points, gathered[0]), dtype, position_scratch), 0);
 
+    const uint8_t colors_channel = input.colors.num_components;
     if(colors_channel){
       const int color_att_id = pcb.AddAttribute(
         draco::GeometryAttribute::COLOR, colors_channel, draco::DataType::DT_UINT8
       );
       pcb.SetAttributeUniqueId(color_att_id, next_unique_id);
       next_unique_id++;
-      for (draco::PointIndex i(0); i < num_points; i++) {
-        pcb.SetAttributeValueForPoint(pos_att_id, i, points.data() + 3 * i.value());
-        pcb.SetAttributeValueForPoint(color_att_id, i, colors.data() + colors_channel * i.value());
-      }
-    } else {
-      for (draco::PointIndex i(0); i < num_points; i++) {
-        pcb.SetAttributeValueForPoint(pos_att_id, i, points.data() + 3 * i.value());
-      }
+      std::vector<uint8_t> colors_scratch;
+      pcb.SetAttributeValuesForAllPoints(color_att_id, view_values_as(rows(input.colors, gathered[1]), draco::DT_UINT8, colors_scratch), 0);
     }
 
     // GENERIC ATTRIBUTES
     for (size_t j = 0; j < unique_ids.size(); ++j) {
-      draco::DataType dtype = static_cast<draco::DataType>(attr_data_types[j]);
-      int num_components = attr_num_components[j];
-      if (dtype != draco::DT_FLOAT32 && dtype != draco::DT_UINT8 && dtype != draco::DT_UINT16 && dtype != draco::DT_UINT32) {
+      const ArrayView &values = input.attr_data[j];
+      draco::DataType dtype = generic_data_type(values.data_type);
+      int num_components = values.num_components;
+      if (dtype == draco::DT_INVALID) {
         std::ostringstream oss;
         oss << "Unsupported attribute data type for attribute with unique id " << int(unique_ids[j]);
         throw std::invalid_argument(oss.str());
@@ -596,45 +1882,665 @@ namespace DracoFunctions {
         pcb.SetAttributeUniqueId(att_id, next_unique_id);
         next_unique_id++;
       }
-      if (!attr_names[j].empty()) {
+      if (!input.attr_names[j].empty()) {
         auto attribute_metadata = std::unique_ptr<draco::AttributeMetadata>(new draco::AttributeMetadata());
-        attribute_metadata->AddEntryString("name", attr_names[j]);
+        attribute_metadata->AddEntryString("name", input.attr_names[j]);
         pcb.AddAttributeMetadata(att_id, std::move(attribute_metadata));
       }
 
-      if (dtype == draco::DT_FLOAT32) {
-        pcb.SetAttributeValuesForAllPoints(att_id, attr_float_data[j].data(), 0);
-      } else if (dtype == draco::DT_UINT8) {
-        pcb.SetAttributeValuesForAllPoints(att_id, attr_uint8_data[j].data(), 0);
-      } else if (dtype == draco::DT_UINT16) {
-        pcb.SetAttributeValuesForAllPoints(att_id, attr_uint16_data[j].data(), 0);
-      } else if (dtype == draco::DT_UINT32) {
-        pcb.SetAttributeValuesForAllPoints(att_id, attr_uint32_data[j].data(), 0);
-      }
+      std::vector<uint8_t> scratch;
+      pcb.SetAttributeValuesForAllPoints(att_id, view_values_as(rows(values, gathered[2 + j]), dtype, scratch), 0);
     }
 
-    std::unique_ptr<draco::PointCloud> ptr_point_cloud = pcb.Finalize(!preserve_order);
+    int permutation_unique_id = -1;
+    if (input.store_permutation) {
+      const int att_id = pcb.AddAttribute(draco::GeometryAttribute::GENERIC, 1, draco::DT_UINT32);
+      permutation_unique_id = next_unique_id;
+      pcb.SetAttributeUniqueId(att_id, next_unique_id);
+      next_unique_id++;
+      auto attribute_metadata = std::unique_ptr<draco::AttributeMetadata>(new draco::AttributeMetadata());
+      attribute_metadata->AddEntryString("name", "point_permutation");
+      pcb.AddAttributeMetadata(att_id, std::move(attribute_metadata));
+      pcb.SetAttributeValuesForAllPoints(att_id, order.data(), 0);
+    }
+
+    // Sorted points are not deduplicated either, which would not keep
+    // their order.
+    std::unique_ptr<draco::PointCloud> ptr_point_cloud = pcb.Finalize(!input.preserve_order && !sorted);
+    clock.lap(&NativeStats::build);
+    if (stats) {
+      stats->native_bytes = geometry_bytes(*ptr_point_cloud, 0);
+    }
     draco::PointCloud *point_cloud = ptr_point_cloud.get();
-    draco::Encoder encoder;
-    setup_encoder_and_metadata(point_cloud, encoder, compression_level, quantization_bits, quantization_range, quantization_origin, create_metadata);
-    if (preserve_order) {
+    if (sorted || permutation_unique_id >= 0) {
+      if (point_cloud->metadata() == nullptr) {
+        point_cloud->AddMetadata(std::unique_ptr<draco::GeometryMetadata>(new draco::GeometryMetadata()));
+      }
+      point_cloud->metadata()->AddEntryInt("point_order", input.point_order);
+      if (permutation_unique_id >= 0) {
+        point_cloud->metadata()->AddEntryInt("point_permutation", permutation_unique_id);
+      }
+    }
+    draco::ExpertEncoder encoder(*point_cloud);
+    setup_encoder_and_metadata(
+      point_cloud, encoder, input.compression_level,
+      input.quantization_bits, input.quantization_range,
+      input.quantization_origin.empty() ? NULL : input.quantization_origin.data(),
+      input.create_metadata
+    );
+    apply_attribute_options(*point_cloud, encoder, input, permutation_unique_id);
+    if (input.encoding_method >= 0) {
+      encoder.SetEncodingMethod(input.encoding_method);
+    }
+    else if (input.preserve_order || sorted) {
       encoder.SetEncodingMethod(draco::POINT_CLOUD_SEQUENTIAL_ENCODING);
     }
 
-    draco::EncoderBuffer buffer;
-    const draco::Status status = encoder.EncodePointCloudToBuffer(*point_cloud, &buffer);
+    const draco::Status status = encoder.EncodeToBuffer(&buffer);
+    clock.lap(&NativeStats::draco);
+    if (!status.ok()) {
+      std::cerr << "Draco encoding error: " << status.error_msg_string() << std::endl;
+      return failed_during_encoding;
+    }
+    return successful_encoding;
+  }
 
+  EncodedObject encode_point_cloud(const EncodeInput &input) {
+    draco::EncoderBuffer buffer;
     EncodedObject encodedPointCloudObject;
-    encodedPointCloudObject.buffer = *((std::vector<unsigned char> *)buffer.buffer());
-    if (status.ok()) {
-      encodedPointCloudObject.encode_status = successful_encoding;
+    encodedPointCloudObject.encode_status = encode_point_cloud(input, buffer, input.collect_stats ? &encodedPointCloudObject.stats : nullptr);
+    copy_buffer(buffer, encodedPointCloudObject.buffer);
+    return encodedPointCloudObject;
+  }
+
+  encoding_status encode_input(const EncodeInput &input, draco::EncoderBuffer &buffer, NativeStats *stats = nullptr) {
+    if (input.is_mesh) {
+      return encode_mesh(input, buffer, stats);
     }
-    else {
-      std::cerr << "Draco encoding error: " << status.error_msg_string() << std::endl;
-      encodedPointCloudObject.encode_status = failed_during_encoding;
+    return encode_point_cloud(input, buffer, stats);
+  }
+
+  EncodedObject encode_input(const EncodeInput &input) {
+    if (input.is_mesh) {
+      return encode_mesh(input);
     }
+    return encode_point_cloud(input);
+  }
 
-    return encodedPointCloudObject;
+  // Keeps one output buffer across encodes so that a stream of small
+  // encodes reuses its capacity instead of reallocating every time.
+  class EncoderContext {
+   public:
+    // Encodes |input| into the context's buffer, replacing its previous
+    // contents. data() and size() describe the result until the next call.
+    encoding_status encode(const EncodeInput &input) {
+      buffer_.Clear();
+      stats_ = NativeStats();
+      return encode_input(input, buffer_, input.collect_stats ? &stats_ : nullptr);
+    }
+
+    const char *data() const { return buffer_.data(); }
+    std::size_t size() const { return buffer_.size(); }
+    const NativeStats &stats() const { return stats_; }
+
+   private:
+    draco::EncoderBuffer buffer_;
+    NativeStats stats_;
+  };
+
+  // Encodes every input on a pool of num_threads native threads.
+  // Results are returned in input order.
+  std::vector<EncodedObject> encode_inputs(const std::vector<EncodeInput*> &inputs, const int num_threads) {
+    std::vector<EncodedObject> encodedObjects(inputs.size());
+    parallel_for(inputs.size(), num_threads, [&](std::size_t i) {
+      encodedObjects[i] = encode_input(*inputs[i]);
+    });
+    return encodedObjects;
+  }
+
+  // Quadric error metric simplification (Garland & Heckbert) restricted
+  // to half-edge collapses: a vertex is always merged into one of its
+  // neighbours, so every vertex of a simplified mesh is an input vertex
+  // that keeps its attribute values and its place on the quantization
+  // grid. Boundary edges are held in place by perpendicular planes, and
+  // collapses that would break the link condition (and so the manifold)
+  // or flip a face are rejected.
+  class QuadricDecimator {
+   public:
+    QuadricDecimator(std::vector<double> positions, std::vector<uint32_t> faces)
+        : positions_(std::move(positions)), faces_(std::move(faces)),
+          num_faces_(faces_.size() / 3), live_faces_(faces_.size() / 3),
+          face_alive_(faces_.size() / 3, 1),
+          quadrics_(positions_.size() / 3, Quadric()),
+          versions_(positions_.size() / 3, 0),
+          vertex_faces_(positions_.size() / 3) {
+      init();
+    }
+
+    // Collapses edges until at most |target_faces| faces remain (or no
+    // collapse is possible) and returns the remaining faces. Successive
+    // calls continue from the previous result, so targets must decrease.
+    // Collapses that are rejected are retried, in both directions and at
+    // their current cost, once the queue runs dry, for as long as other
+    // collapses keep changing the mesh around them.
+    std::vector<uint32_t> decimate(const std::size_t target_faces) {
+      bool collapsed = true;
+      while (live_faces_ > target_faces) {
+        if (heap_.empty()) {
+          if (!collapsed || rejected_.empty()) {
+            break;
+          }
+          for (const Collapse &collapse : rejected_) {
+            if (current(collapse)) {
+              push_collapse(collapse.from, collapse.to);
+              push_collapse(collapse.to, collapse.from);
+            }
+          }
+          rejected_.clear();
+          collapsed = false;
+          continue;
+        }
+        const Collapse collapse = heap_.top();
+        heap_.pop();
+        if (!current(collapse)) {
+          continue;
+        }
+        if (collapse_edge(collapse.from, collapse.to)) {
+          collapsed = true;
+        }
+        else {
+          rejected_.push_back(collapse);
+        }
+      }
+      std::vector<uint32_t> faces;
+      faces.reserve(live_faces_ * 3);
+      for (std::size_t f = 0; f < num_faces_; ++f) {
+        if (face_alive_[f]) {
+          faces.insert(faces.end(), &faces_[3 * f], &faces_[3 * f] + 3);
+        }
+      }
+      return faces;
+    }
+
+   private:
+    typedef std::array<double, 10> Quadric;
+    typedef std::array<double, 3> Vec3;
+
+    struct Collapse {
+      double cost;
+      uint32_t from, to;
+      uint32_t from_version, to_version;
+      // std::priority_queue is a max-heap; order it by lowest cost.
+      bool operator<(const Collapse &other) const { return cost > other.cost; }
+    };
+
+    static constexpr double kBoundaryWeight = 1000.0;
+
+    Vec3 position(const uint32_t v) const {
+      return Vec3{{ positions_[3 * v], positions_[3 * v + 1], positions_[3 * v + 2] }};
+    }
+
+    static Vec3 sub(const Vec3 &a, const Vec3 &b) {
+      return Vec3{{ a[0] - b[0], a[1] - b[1], a[2] - b[2] }};
+    }
+
+    static Vec3 cross(const Vec3 &a, const Vec3 &b) {
+      return Vec3{{ a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] }};
+    }
+
+    static double dot(const Vec3 &a, const Vec3 &b) {
+      return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    Vec3 face_normal(const uint32_t a, const uint32_t b, const uint32_t c) const {
+      return cross(sub(position(b), position(a)), sub(position(c), position(a)));
+    }
+
+    // Adds weight * (n.p + d)^2 for the plane through |p| with unit normal |n|.
+    static void add_plane(Quadric &q, const Vec3 &n, const Vec3 &p, const double weight) {
+      const double d = -dot(n, p);
+      q[0] += weight * n[0] * n[0]; q[1] += weight * n[0] * n[1]; q[2] += weight * n[0] * n[2]; q[3] += weight * n[0] * d;
+      q[4] += weight * n[1] * n[1]; q[5] += weight * n[1] * n[2]; q[6] += weight * n[1] * d;
+      q[7] += weight * n[2] * n[2]; q[8] += weight * n[2] * d;
+      q[9] += weight * d * d;
+    }
+
+    static double evaluate(const Quadric &q, const Vec3 &p) {
+      const double x = p[0], y = p[1], z = p[2];
+      return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+           + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+           + q[7] * z * z + 2 * q[8] * z
+           + q[9];
+    }
+
+    void init() {
+      const std::size_t num_vertices = quadrics_.size();
+      // (edge key, face) for every face edge; the key is (min << 32 | max).
+      std::vector<std::pair<uint64_t, uint32_t>> edges;
+      edges.reserve(num_faces_ * 3);
+
+      for (std::size_t f = 0; f < num_faces_; ++f) {
+        const uint32_t *v = &faces_[3 * f];
+        if (v[0] >= num_vertices || v[1] >= num_vertices || v[2] >= num_vertices) {
+          throw std::invalid_argument("Face references a vertex that does not exist.");
+        }
+        if (v[0] == v[1] || v[1] == v[2] || v[0] == v[2]) {
+          face_alive_[f] = 0;
+          live_faces_--;
+          continue;
+        }
+        Vec3 n = face_normal(v[0], v[1], v[2]);
+        const double length = std::sqrt(dot(n, n));
+        for (int k = 0; k < 3; ++k) {
+          vertex_faces_[v[k]].push_back(f);
+          const uint32_t a = std::min(v[k], v[(k + 1) % 3]);
+          const uint32_t b = std::max(v[k], v[(k + 1) % 3]);
+          edges.emplace_back((static_cast<uint64_t>(a) << 32) | b, f);
+        }
+        if (length > 0) {
+          n = Vec3{{ n[0] / length, n[1] / length, n[2] / length }};
+          const Vec3 p = position(v[0]);
+          for (int k = 0; k < 3; ++k) {
+            add_plane(quadrics_[v[k]], n, p, 0.5 * length);
+          }
+        }
+      }
+
+      std::sort(edges.begin(), edges.end());
+      for (std::size_t i = 0; i < edges.size();) {
+        std::size_t j = i + 1;
+        while (j < edges.size() && edges[j].first == edges[i].first) {
+          ++j;
+        }
+        const uint32_t a = static_cast<uint32_t>(edges[i].first >> 32);
+        const uint32_t b = static_cast<uint32_t>(edges[i].first & 0xffffffffu);
+        if (j - i == 1) {
+          add_boundary_planes(a, b, edges[i].second);
+        }
+        i = j;
+      }
+      for (std::size_t i = 0; i < edges.size(); ++i) {
+        if (i == 0 || edges[i].first != edges[i - 1].first) {
+          push_edge(static_cast<uint32_t>(edges[i].first >> 32), static_cast<uint32_t>(edges[i].first & 0xffffffffu));
+        }
+      }
+    }
+
+    void add_boundary_planes(const uint32_t a, const uint32_t b, const uint32_t face) {
+      const uint32_t *v = &faces_[3 * face];
+      const Vec3 edge = sub(position(b), position(a));
+      Vec3 n = cross(edge, face_normal(v[0], v[1], v[2]));
+      const double length = std::sqrt(dot(n, n));
+      if (length == 0) {
+        return;
+      }
+      n = Vec3{{ n[0] / length, n[1] / length, n[2] / length }};
+      const double weight = kBoundaryWeight * dot(edge, edge);
+      add_plane(quadrics_[a], n, position(a), weight);
+      add_plane(quadrics_[b], n, position(a), weight);
+    }
+
+    double collapse_cost(const uint32_t from, const uint32_t to) const {
+      Quadric q;
+      for (int k = 0; k < 10; ++k) {
+        q[k] = quadrics_[from][k] + quadrics_[to][k];
+      }
+      return evaluate(q, position(to));
+    }
+
+    void push_collapse(const uint32_t from, const uint32_t to) {
+      heap_.push(Collapse{ collapse_cost(from, to), from, to, versions_[from], versions_[to] });
+    }
+
+    // Queues the cheaper direction of collapsing the edge (a, b).
+    void push_edge(const uint32_t a, const uint32_t b) {
+      if (collapse_cost(a, b) <= collapse_cost(b, a)) {
+        push_collapse(a, b);
+      } else {
+        push_collapse(b, a);
+      }
+    }
+
+    // Whether neither end of |collapse| changed since it was queued.
+    bool current(const Collapse &collapse) const {
+      return versions_[collapse.from] == collapse.from_version && versions_[collapse.to] == collapse.to_version;
+    }
+
+    // The neighbours of |x|, each with the number of live faces it shares
+    // with |x|, sorted by vertex.
+    std::vector<std::pair<uint32_t, int>> ring(const uint32_t x) const {
+      std::vector<uint32_t> vertices;
+      for (const uint32_t f : vertex_faces_[x]) {
+        if (face_alive_[f]) {
+          for (int k = 0; k < 3; ++k) {
+            if (faces_[3 * f + k] != x) {
+              vertices.push_back(faces_[3 * f + k]);
+            }
+          }
+        }
+      }
+      std::sort(vertices.begin(), vertices.end());
+      std::vector<std::pair<uint32_t, int>> counts;
+      for (const uint32_t w : vertices) {
+        if (counts.empty() || counts.back().first != w) {
+          counts.emplace_back(w, 0);
+        }
+        counts.back().second++;
+      }
+      return counts;
+    }
+
+    bool has_face(const uint32_t a, const uint32_t b, const uint32_t c) const {
+      for (const uint32_t f : vertex_faces_[a]) {
+        const uint32_t *corners = &faces_[3 * f];
+        if (face_alive_[f]
+            && (corners[0] == b || corners[1] == b || corners[2] == b)
+            && (corners[0] == c || corners[1] == c || corners[2] == c)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // The link condition: collapsing the edge (u, v) keeps the mesh
+    // manifold only if the vertices adjacent to both are exactly those
+    // opposite the edge, these are not joined by faces on both sides
+    // (a tetrahedron), and the edge does not join two boundaries.
+    bool keeps_manifold(const uint32_t u, const uint32_t v) const {
+      std::vector<uint32_t> opposite;
+      for (const uint32_t f : vertex_faces_[u]) {
+        const uint32_t *corners = &faces_[3 * f];
+        if (face_alive_[f] && (corners[0] == v || corners[1] == v || corners[2] == v)) {
+          opposite.push_back(corners[0] ^ corners[1] ^ corners[2] ^ u ^ v);
+        }
+      }
+      if (opposite.empty() || opposite.size() > 2) {
+        return false;
+      }
+      std::sort(opposite.begin(), opposite.end());
+
+      const std::vector<std::pair<uint32_t, int>> u_ring = ring(u), v_ring = ring(v);
+      std::vector<uint32_t> common;
+      bool u_boundary = false, v_boundary = false;
+      std::size_t j = 0;
+      for (const auto &entry : u_ring) {
+        u_boundary = u_boundary || entry.second == 1;
+        while (j < v_ring.size() && v_ring[j].first < entry.first) {
+          ++j;
+        }
+        if (j < v_ring.size() && v_ring[j].first == entry.first) {
+          common.push_back(entry.first);
+        }
+      }
+      for (const auto &entry : v_ring) {
+        v_boundary = v_boundary || entry.second == 1;
+      }
+      if (common != opposite) {
+        return false;
+      }
+      if (opposite.size() == 2 && has_face(u, opposite[0], opposite[1]) && has_face(v, opposite[0], opposite[1])) {
+        return false;
+      }
+      return !(u_boundary && v_boundary && opposite.size() != 1);
+    }
+
+    // Merges vertex |u| into vertex |v| unless that makes the mesh
+    // non-manifold or flips a face; returns whether it did.
+    bool collapse_edge(const uint32_t u, const uint32_t v) {
+      if (!keeps_manifold(u, v)) {
+        return false;
+      }
+      for (const uint32_t f : vertex_faces_[u]) {
+        uint32_t *corners = &faces_[3 * f];
+        if (!face_alive_[f] || corners[0] == v || corners[1] == v || corners[2] == v) {
+          continue;
+        }
+        const Vec3 before = face_normal(corners[0], corners[1], corners[2]);
+        uint32_t moved[3] = { corners[0], corners[1], corners[2] };
+        for (int k = 0; k < 3; ++k) {
+          if (moved[k] == u) {
+            moved[k] = v;
+          }
+        }
+        if (dot(before, face_normal(moved[0], moved[1], moved[2])) < 0) {
+          return false;
+        }
+      }
+
+      std::vector<uint32_t> &v_faces = vertex_faces_[v];
+      for (const uint32_t f : vertex_faces_[u]) {
+        uint32_t *corners = &faces_[3 * f];
+        if (!face_alive_[f]) {
+          continue;
+        }
+        if (corners[0] == v || corners[1] == v || corners[2] == v) {
+          face_alive_[f] = 0;
+          live_faces_--;
+          continue;
+        }
+        for (int k = 0; k < 3; ++k) {
+          if (corners[k] == u) {
+            corners[k] = v;
+          }
+        }
+        v_faces.push_back(f);
+      }
+      std::vector<uint32_t>().swap(vertex_faces_[u]);
+      v_faces.erase(
+        std::remove_if(v_faces.begin(), v_faces.end(), [&](uint32_t f) { return !face_alive_[f]; }),
+        v_faces.end()
+      );
+
+      for (int k = 0; k < 10; ++k) {
+        quadrics_[v][k] += quadrics_[u][k];
+      }
+      versions_[u]++;
+      versions_[v]++;
+
+      std::vector<uint32_t> neighbours;
+      neighbours.reserve(v_faces.size() * 2);
+      for (const uint32_t f : v_faces) {
+        for (int k = 0; k < 3; ++k) {
+          if (faces_[3 * f + k] != v) {
+            neighbours.push_back(faces_[3 * f + k]);
+          }
+        }
+      }
+      std::sort(neighbours.begin(), neighbours.end());
+      neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+      for (const uint32_t w : neighbours) {
+        push_edge(v, w);
+      }
+      return true;
+    }
+
+    std::vector<double> positions_;
+    std::vector<uint32_t> faces_;
+    const std::size_t num_faces_;
+    std::size_t live_faces_;
+    std::vector<uint8_t> face_alive_;
+    std::vector<Quadric> quadrics_;
+    std::vector<uint32_t> versions_;
+    std::vector<std::vector<uint32_t>> vertex_faces_;
+    std::priority_queue<Collapse> heap_;
+    std::vector<Collapse> rejected_;
+  };
+
+  // A copy of the mesh |input| with an explicit quantization origin and
+  // range (the bounds of |positions| unless the input has them), so that
+  // any subset of its faces quantizes its vertices exactly as the whole.
+  EncodeInput shared_quantization(const EncodeInput &input, const std::vector<double> &positions) {
+    EncodeInput shared = input;
+    shared.is_mesh = true;
+    if (shared.quantization_origin.size() < 3 || shared.quantization_range <= 0.f) {
+      double lo[3], hi[3];
+      position_bounds(positions, lo, hi);
+      if (shared.quantization_origin.size() < 3) {
+        shared.quantization_origin.assign(lo, lo + 3);
+      }
+      float range = 0.f;
+      for (int axis = 0; axis < 3; ++axis) {
+        range = std::max(range, static_cast<float>(hi[axis] - shared.quantization_origin[axis]));
+      }
+      shared.quantization_range = range > 0.f ? range : 1.f;
+    }
+    return shared;
+  }
+
+  // Encodes |input| once per entry of |levels|, the fraction of its faces
+  // kept at that level of detail. Coarser levels are simplified by one
+  // QuadricDecimator, finest first, and then all levels are encoded on
+  // |num_threads| threads with the same quantization origin and range so
+  // that their vertices line up exactly.
+  std::vector<EncodedObject> encode_lods(const EncodeInput &input, const std::vector<float> &levels, const int num_threads) {
+    const std::size_t num_points = input.points.num_rows;
+    const std::size_t num_faces = input.faces.num_rows;
+    std::vector<double> positions(num_points * 3);
+    copy_view_as(input.points, positions.data());
+    EncodeInput shared = shared_quantization(input, positions);
+    shared.num_threads = 1;  // the parts are already encoded in parallel
+
+    std::vector<std::size_t> order(levels.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return levels[a] > levels[b]; });
+
+    std::vector<std::vector<uint32_t>> level_faces(levels.size());
+    std::unique_ptr<QuadricDecimator> decimator;
+    for (const std::size_t i : order) {
+      if (levels[i] >= 1.f) {
+        continue;
+      }
+      if (levels[i] <= 0.f) {
+        throw std::invalid_argument("Levels of detail must be in the range (0, 1].");
+      }
+      if (!decimator) {
+        std::vector<uint32_t> faces(num_faces * 3);
+        copy_view_as(input.faces, faces.data());
+        decimator.reset(new QuadricDecimator(positions, std::move(faces)));
+      }
+      level_faces[i] = decimator->decimate(static_cast<std::size_t>(std::ceil(levels[i] * num_faces)));
+    }
+    decimator.reset();
+
+    std::vector<EncodedObject> encodedObjects(levels.size());
+    parallel_for(levels.size(), num_threads, [&](std::size_t i) {
+      if (levels[i] >= 1.f) {
+        encodedObjects[i] = encode_mesh(shared);
+        return;
+      }
+      LevelInput level(shared, std::move(level_faces[i]));
+      encodedObjects[i] = encode_mesh(level.input);
+    });
+    return encodedObjects;
+  }
+
+  // The non-empty cells of a partitioned encode, in increasing cell order.
+  struct PartitionedObject {
+    std::vector<EncodedObject> cells;
+    std::vector<uint32_t> cell_ids;  // x + nx * (y + ny * z)
+    std::vector<std::size_t> num_points;
+    std::vector<std::size_t> num_faces;
+    std::vector<double> bounds;  // min xyz, max xyz of the vertices of each cell
+    std::vector<float> quantization_origin;
+    float quantization_range;
+  };
+
+  // Splits the mesh |input| on a |grid| of nx * ny * nz cells spanning its
+  // bounding box, assigning each face to the cell holding its centroid,
+  // and encodes the cells on |num_threads| threads. Vertices on a seam are
+  // written to every cell using them; since all cells share one
+  // quantization origin and range, they decode to identical positions.
+  PartitionedObject encode_partitioned(const EncodeInput &input, const std::vector<int> &grid, const int num_threads) {
+    if (grid.size() != 3 || grid[0] < 1 || grid[1] < 1 || grid[2] < 1) {
+      throw std::invalid_argument("The partition grid must be three positive cell counts.");
+    }
+    const std::size_t num_points = input.points.num_rows;
+    const std::size_t num_faces = input.faces.num_rows;
+    std::vector<double> positions(num_points * 3);
+    copy_view_as(input.points, positions.data());
+    std::vector<uint32_t> faces(num_faces * 3);
+    copy_view_as(input.faces, faces.data());
+    for (const uint32_t v : faces) {
+      if (v >= num_points) {
+        throw std::invalid_argument("Faces reference vertices that do not exist.");
+      }
+    }
+    EncodeInput shared = shared_quantization(input, positions);
+    shared.num_threads = 1;  // the parts are already encoded in parallel
+
+    double lo[3], hi[3], scale[3];
+    position_bounds(positions, lo, hi);
+    for (int axis = 0; axis < 3; ++axis) {
+      scale[axis] = hi[axis] > lo[axis] ? grid[axis] / (hi[axis] - lo[axis]) : 0;
+    }
+
+    // Counting sort of the faces by cell.
+    const std::size_t num_cells = static_cast<std::size_t>(grid[0]) * grid[1] * grid[2];
+    std::vector<uint32_t> face_cells(num_faces);
+    std::vector<std::size_t> cell_starts(num_cells + 1, 0);
+    for (std::size_t f = 0; f < num_faces; ++f) {
+      std::size_t cell = 0;
+      for (int axis = 2; axis >= 0; --axis) {
+        double centroid = 0;
+        for (int corner = 0; corner < 3; ++corner) {
+          centroid += positions[3 * faces[3 * f + corner] + axis];
+        }
+        const double offset = (centroid / 3 - lo[axis]) * scale[axis];
+        const int index = std::min(std::max(static_cast<int>(offset), 0), grid[axis] - 1);
+        cell = cell * grid[axis] + index;
+      }
+      face_cells[f] = static_cast<uint32_t>(cell);
+      ++cell_starts[cell + 1];
+    }
+    for (std::size_t cell = 0; cell < num_cells; ++cell) {
+      cell_starts[cell + 1] += cell_starts[cell];
+    }
+
+    PartitionedObject partitioned;
+    partitioned.quantization_origin = shared.quantization_origin;
+    partitioned.quantization_range = shared.quantization_range;
+    for (std::size_t cell = 0; cell < num_cells; ++cell) {
+      if (cell_starts[cell + 1] > cell_starts[cell]) {
+        partitioned.cell_ids.push_back(static_cast<uint32_t>(cell));
+      }
+    }
+    std::vector<std::vector<uint32_t>> cell_faces(partitioned.cell_ids.size());
+    for (std::size_t i = 0; i < cell_faces.size(); ++i) {
+      const uint32_t cell = partitioned.cell_ids[i];
+      cell_faces[i].reserve(3 * (cell_starts[cell + 1] - cell_starts[cell]));
+    }
+    std::vector<std::size_t> slot(num_cells, 0);
+    for (std::size_t i = 0; i < cell_faces.size(); ++i) {
+      slot[partitioned.cell_ids[i]] = i;
+    }
+    for (std::size_t f = 0; f < num_faces; ++f) {
+      std::vector<uint32_t> &out = cell_faces[slot[face_cells[f]]];
+      out.insert(out.end(), faces.begin() + 3 * f, faces.begin() + 3 * f + 3);
+    }
+    faces = std::vector<uint32_t>();
+
+    const std::size_t num_parts = partitioned.cell_ids.size();
+    partitioned.cells.resize(num_parts);
+    partitioned.num_points.resize(num_parts);
+    partitioned.num_faces.resize(num_parts);
+    partitioned.bounds.resize(6 * num_parts);
+    parallel_for(num_parts, num_threads, [&](std::size_t i) {
+      double *bounds = &partitioned.bounds[6 * i];
+      for (std::size_t k = 0; k < cell_faces[i].size(); ++k) {
+        const double *p = &positions[3 * cell_faces[i][k]];
+        for (int axis = 0; axis < 3; ++axis) {
+          bounds[axis] = (k == 0) ? p[axis] : std::min(bounds[axis], p[axis]);
+          bounds[3 + axis] = (k == 0) ? p[axis] : std::max(bounds[3 + axis], p[axis]);
+        }
+      }
+      partitioned.num_faces[i] = cell_faces[i].size() / 3;
+      LevelInput part(shared, std::move(cell_faces[i]));
+      partitioned.num_points[i] = part.input.points.num_rows;
+      partitioned.cells[i] = encode_mesh(part.input);
+    });
+    return partitioned;
   }
 
 };
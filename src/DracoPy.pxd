@@ -1,6 +1,6 @@
 #cython: language_level=3
 from libcpp.vector cimport vector
-from libc.stdint cimport int8_t, uint8_t, uint16_t, uint32_t
+from libc.stdint cimport int8_t, uint8_t, uint16_t, uint32_t, uint64_t
 from libcpp cimport bool
 from libcpp.string cimport string
 
@@ -9,99 +9,202 @@ import numpy as np
 
 cnp.import_array()
 
-cdef extern from "DracoPy.h" namespace "DracoFunctions":
+cdef extern from "DracoPy.h" namespace "DracoFunctions" nogil:
 
     cdef enum decoding_status:
         successful, not_draco_encoded, no_position_attribute,
-        failed_during_decoding
+        failed_during_decoding, exceeds_limits
 
     cdef enum encoding_status:
         successful_encoding, failed_during_encoding
 
+    cdef enum weld_mode:
+        weld_draco, weld_none, weld_exact, weld_quantized
+
+    cdef enum point_order_mode:
+        order_input, order_morton, order_hilbert
+
     cdef struct AttributeData:
         int unique_id
         int num_components
         int data_type
         int attribute_type
         string name
-        vector[float] float_data
-        vector[uint32_t] uint_data
-        vector[uint8_t] byte_data
+        int attribute_id
+        int quantization_bits
+        double quantization_range
+        vector[double] quantization_origin
+        int prediction_scheme
+
+    cdef struct NativeStats:
+        double header
+        double draco
+        double describe
+        double build
+        size_t native_bytes
+        size_t welded_vertices
 
     cdef struct PointCloudObject:
         vector[AttributeData] attributes
+        unsigned int num_points
         # Encoding options
         bool encoding_options_set
         int quantization_bits
         double quantization_range
         vector[double] quantization_origin
+        int point_order
+        int permutation_unique_id
 
         # Represents the decoding success or error message
         decoding_status decode_status
+        string error_message
+        NativeStats stats
 
     cdef struct MeshObject:
         vector[AttributeData] attributes
+        unsigned int num_points
         # Encoding options
         bool encoding_options_set
         int quantization_bits
         double quantization_range
         vector[double] quantization_origin
+        int point_order
+        int permutation_unique_id
 
         # Represents the decoding success or error message
         decoding_status decode_status
+        string error_message
+        NativeStats stats
         
         # Mesh-specific
-        vector[unsigned int] faces
+        bool is_mesh
+        unsigned int num_faces
+
+    cdef struct ProbeObject:
+        vector[AttributeData] attributes
+        unsigned int num_points
+        bool encoding_options_set
+        int quantization_bits
+        double quantization_range
+        vector[double] quantization_origin
+        int point_order
+        int permutation_unique_id
+        decoding_status decode_status
+        string error_message
+        NativeStats stats
+        bool is_mesh
+        unsigned int num_faces
+
+        # Header fields
+        int geometry_type
+        int encoding_method
 
     cdef struct EncodedObject:
-        vector[unsigned char] buffer
+        vector[char] buffer
         encoding_status encode_status
+        NativeStats stats
+
+    cdef struct BufferView:
+        const char *data
+        size_t size
+
+    cdef struct ArrayView:
+        const void *data
+        size_t num_rows
+        int num_components
+        int data_type
+
+    cdef struct AttributeOptions:
+        int attribute_type
+        int generic_index
+        int quantization_bits
+        vector[float] quantization_origin
+        float quantization_range
+        int prediction_scheme
+
+    cdef struct EncodeInput:
+        bool is_mesh
+        ArrayView points
+        ArrayView faces
+        int quantization_bits
+        int compression_level
+        float quantization_range
+        vector[float] quantization_origin
+        bool preserve_order
+        bool create_metadata
+        ArrayView colors
+        ArrayView tex_coord
+        ArrayView normals
+        vector[int8_t] unique_ids
+        vector[ArrayView] attr_data
+        vector[string] attr_names
+        vector[AttributeOptions] attribute_options
+        int weld
+        int point_order
+        int encoding_method
+        bool store_permutation
+        int num_threads
+        bool collect_stats
+
+    cdef cppclass AttributeFilter:
+        bool all
+        vector[int] types
+        vector[int] unique_ids
+        vector[string] names
+
+    cdef cppclass DecodeLimits:
+        uint64_t max_points
+        uint64_t max_faces
+        uint64_t max_attributes
+        uint64_t max_output_bytes
+
+    cdef cppclass DecodeOptions:
+        AttributeFilter attributes
+        bool quantized_positions
+        bool collect_stats
+        vector[double] bbox
+        DecodeLimits limits
 
     MeshObject decode_buffer(const char *buffer, size_t buffer_len) except +
+    MeshObject decode_buffer(const char *buffer, size_t buffer_len, const DecodeOptions &options) except +
+
+    cdef cppclass DecoderContext:
+        DecoderContext(const DecodeOptions &options) except +
+        MeshObject decode(const char *buffer, size_t buffer_len) except +
+        const DecodeOptions &options()
+        void set_collect_stats(bool collect_stats)
+        void set_bbox(const vector[double] &bbox)
+
+    vector[MeshObject] decode_buffers(const vector[BufferView] &buffers, const DecodeOptions &options, const int num_threads) except +
+
+    ProbeObject probe_buffer(const char *buffer, size_t buffer_len) except +
+
+    int decoded_data_type(const int data_type)
+    void copy_faces(const MeshObject &mesh_object, uint32_t *out) except +
+    void copy_attribute(const MeshObject &mesh_object, const int index, void *out) except +
+    void copy_geometry(const MeshObject &mesh_object, uint32_t *faces_out, const vector[void*] &attribute_outs, const int num_threads) except +
+    void release_geometry(MeshObject &mesh_object)
+
+    EncodedObject encode_mesh(const EncodeInput &input) except +
+    EncodedObject encode_point_cloud(const EncodeInput &input) except +
+    EncodedObject encode_input(const EncodeInput &input) except +
+    cdef cppclass EncoderContext:
+        EncoderContext() except +
+        encoding_status encode(const EncodeInput &input) except +
+        const char *data()
+        size_t size()
+        const NativeStats &stats()
+
+    vector[EncodedObject] encode_inputs(const vector[EncodeInput*] &inputs, const int num_threads) except +
+    vector[EncodedObject] encode_lods(const EncodeInput &input, const vector[float] &levels, const int num_threads) except +
+
+    cdef struct PartitionedObject:
+        vector[EncodedObject] cells
+        vector[uint32_t] cell_ids
+        vector[size_t] num_points
+        vector[size_t] num_faces
+        vector[double] bounds
+        vector[float] quantization_origin
+        float quantization_range
 
-    EncodedObject encode_mesh(
-        const vector[float] points,
-        const vector[uint32_t] faces,
-        const int quantization_bits,
-        const int compression_level,
-        const float quantization_range,
-        const float *quantization_origin,
-        const bool preserve_order,
-        const bool create_metadata,
-        const int integer_mark,
-        const vector[uint8_t] colors,
-        const uint8_t colors_channel,
-        const vector[float] tex_coord,
-        const uint8_t tex_coord_channel,
-        const vector[float] normals,
-        const uint8_t has_normals,
-        vector[int8_t]& unique_ids,
-        vector[vector[float]]& attr_float_data,
-        vector[vector[uint8_t]]& attr_uint8_data,
-        vector[vector[uint16_t]]& attr_uint16_data,
-        vector[vector[uint32_t]]& attr_uint32_data,
-        vector[int]& attr_data_types,
-        vector[int]& attr_num_components,
-        vector[string]& attr_names
-    ) except +
-
-    EncodedObject encode_point_cloud(
-        const vector[float] points,
-        const int quantization_bits,
-        const int compression_level,
-        const float quantization_range,
-        const float *quantization_origin,
-        const bool preserve_order,
-        const bool create_metadata,
-        const int integer_mark,
-        const vector[uint8_t] colors,
-        const uint8_t colors_channel,
-        vector[int8_t]& unique_ids,
-        vector[vector[float]]& attr_float_data,
-        vector[vector[uint8_t]]& attr_uint8_data,
-        vector[vector[uint16_t]]& attr_uint16_data,
-        vector[vector[uint32_t]]& attr_uint32_data,
-        vector[int]& attr_data_types,
-        vector[int]& attr_num_components,
-        vector[string]& attr_names
-    ) except +
+    PartitionedObject encode_partitioned(const EncodeInput &input, const vector[int] &grid, const int num_threads) except +
@@ -1,9 +1,14 @@
 # distutils: language = c++
 from typing import Union, cast
 
+from cpython.bytes cimport PyBytes_FromStringAndSize
 from cpython.mem cimport PyMem_Malloc, PyMem_Free
 cimport DracoPy
+import mmap
+import os
 import struct
+import threading
+import time
 from math import floor
 from libcpp.string cimport string
 from libc.string cimport memcmp
@@ -40,6 +45,38 @@ class AttributeType(IntEnum):
     TEX_COORD = 3
     GENERIC = 4
 
+class EncodedGeometryType(IntEnum):
+    INVALID_GEOMETRY_TYPE = -1
+    POINT_CLOUD = 0
+    TRIANGULAR_MESH = 1
+
+class PredictionScheme(IntEnum):
+    NONE = -2
+    UNDEFINED = -1
+    DIFFERENCE = 0
+    PARALLELOGRAM = 1
+    MULTI_PARALLELOGRAM = 2
+    TEX_COORDS_DEPRECATED = 3
+    CONSTRAINED_MULTI_PARALLELOGRAM = 4
+    TEX_COORDS_PORTABLE = 5
+    GEOMETRIC_NORMAL = 6
+
+NUMPY_DTYPES = {
+    DataType.DT_INT8: np.int8,
+    DataType.DT_UINT8: np.uint8,
+    DataType.DT_INT16: np.int16,
+    DataType.DT_UINT16: np.uint16,
+    DataType.DT_INT32: np.int32,
+    DataType.DT_UINT32: np.uint32,
+    DataType.DT_INT64: np.int64,
+    DataType.DT_UINT64: np.uint64,
+    DataType.DT_FLOAT32: np.float32,
+    DataType.DT_FLOAT64: np.float64,
+    DataType.DT_BOOL: np.bool_,
+}
+
+DATA_TYPES = { np.dtype(dtype): data_type for data_type, dtype in NUMPY_DTYPES.items() }
+
 class DracoPointCloud:
     def __init__(self, data_struct):
         self.data_struct = data_struct
@@ -49,41 +86,7 @@ class DracoPointCloud:
         else:
             self.encoding_options = None
 
-        self._attributes = []
-        
-        attributes_list = self.data_struct['attributes']
-        
-        if len(attributes_list) > 0:    
-            for attr in attributes_list:
-                attr_info = {
-                    'unique_id': attr.get('unique_id', 0),
-                    'num_components': attr.get('num_components', 0),
-                    'data_type': attr.get('data_type', 0),
-                    'attribute_type': attr.get('attribute_type', 0),
-                    'data': None
-                }
-                float_data = attr.get('float_data', [])
-                uint_data = attr.get('uint_data', [])
-                byte_data = attr.get('byte_data', [])
-
-                # Get the appropriate data array based on data type
-                data_array = None
-                if len(float_data) > 0:
-                    data_array = np.array(float_data, dtype=np.float32)
-                elif len(uint_data) > 0:
-                    data_array = np.array(uint_data, dtype=np.uint32)
-                elif len(byte_data) > 0:
-                    data_array = np.array(byte_data, dtype=np.uint8)
-
-                if data_array is not None:
-                    attr_info['data'] = data_array.reshape((-1, attr_info['num_components']))
-                else:
-                    attr_info['data'] = None
-
-                name = attr.get('name', None)
-                attr_info['name'] = name.decode('utf-8') if name else None
-
-                self._attributes.append(attr_info)
+        self._attributes = list(self.data_struct['attributes'])
 
     def get_encoded_coordinate(self, value, axis):
         if self.encoding_options is not None:
@@ -133,12 +136,42 @@ class DracoPointCloud:
             return color_attr['data']
         return None
 
+    @property
+    def point_order(self):
+        # 'morton' or 'hilbert' for clouds encoded with that point_order
+        return POINT_ORDER_NAMES.get(self.data_struct.get('point_order'))
+
+    @property
+    def point_permutation(self):
+        # input index of every point, for clouds encoded with store_permutation
+        unique_id = self.data_struct.get('permutation_unique_id', -1)
+        permutation_attr = self.get_attribute_by_unique_id(unique_id) if unique_id >= 0 else None
+        if permutation_attr and permutation_attr['data'] is not None:
+            return permutation_attr['data'][:, 0]
+        return None
+
+    def block_bounds(self, block_size=4096):
+        """
+        Bounding boxes (min xyz, max xyz) of each run of block_size
+        consecutive points, as a float64 array of shape (N, 6). With a
+        point_order the runs are compact, so the boxes index the cloud
+        for spatial queries without sorting it again.
+        """
+        points = self.points
+        if points is None or len(points) == 0:
+            return np.zeros((0, 6), dtype=np.float64)
+        starts = np.arange(0, len(points), block_size)
+        return np.hstack([
+            np.minimum.reduceat(points, starts, axis=0),
+            np.maximum.reduceat(points, starts, axis=0),
+        ]).astype(np.float64)
+
 class DracoMesh(DracoPointCloud):
     @property
     def faces(self):
-        faces_ = self.data_struct['faces']
-        N = len(faces_) // 3
-        return np.array(faces_, dtype=np.uint32).reshape((N, 3))
+        if self.data_struct['faces'] is None and self.data_struct.get('geometry') is not None:
+            self.data_struct['faces'] = self.data_struct['geometry'].faces()
+        return self.data_struct['faces']
 
     @property
     def normals(self):
@@ -174,6 +207,38 @@ class EncodingOptions(object):
             encoded_point.append(self.get_encoded_coordinate(point[axis], axis))
         return encoded_point
 
+    @property
+    def max_quantized_value(self):
+        return (1 << self.quantization_bits) - 1
+
+    def quantize_points(self, points):
+        """
+        Maps an (N, 3) array of points to their int32 indices on the
+        quantization grid, with the same float32 arithmetic as Draco's
+        encoder. Raises ValueError if a point does not round to a grid
+        index inside the encoded range.
+        """
+        points = np.asarray(points, dtype=np.float32)
+        origin = np.asarray(self.quantization_origin, dtype=np.float32)
+        inverse_delta = np.float32(self.max_quantized_value) / np.float32(self.quantization_range)
+        quantized = np.floor((points - origin) * inverse_delta + np.float32(0.5))
+        if np.any(quantized < 0) or np.any(quantized > self.max_quantized_value):
+            raise ValueError('Specified value out of encoded range')
+        return quantized.astype(np.int32)
+
+    def dequantize_points(self, quantized):
+        """
+        Maps an (N, 3) array of grid indices back to float32 positions,
+        giving exactly the values decode() produces.
+        """
+        origin = np.asarray(self.quantization_origin, dtype=np.float32)
+        delta = np.float32(self.quantization_range) / np.float32(self.max_quantized_value)
+        return np.asarray(quantized).astype(np.float32) * delta + origin
+
+    def get_encoded_points(self, points):
+        """Vectorized get_encoded_point for an (N, 3) array of points."""
+        return self.dequantize_points(self.quantize_points(points))
+
     @property
     def num_axes(self):
         return 3
@@ -184,6 +249,56 @@ class FileTypeException(Exception):
 class EncodingFailedException(Exception):
     pass
 
+class DecodeLimitException(Exception):
+    pass
+
+# STATS
+
+_counters = None
+
+def enable_counters(enabled=True):
+    """
+    Starts (or stops) accumulating the stats of every encode and decode
+    in process-wide counters, read with counters(). Disabled by default;
+    while disabled, and unless a stats dict is passed to a call, no
+    clock is read and nothing is counted.
+    """
+    global _counters
+    if not enabled:
+        _counters = None
+    elif _counters is None:
+        _counters = { 'encode': {}, 'decode': {} }
+
+def reset_counters():
+    """Zeroes the process-wide counters."""
+    if _counters is not None:
+        for totals in _counters.values():
+            totals.clear()
+
+def counters() -> dict:
+    """
+    dict counters()
+
+    Snapshot of the process-wide counters: for 'encode' and 'decode',
+    the number of 'calls' and the sum of every entry of their stats
+    (see encode() and decode()) over those calls.
+    """
+    if _counters is None:
+        return { 'encode': {}, 'decode': {} }
+    return { kind: dict(totals) for kind, totals in _counters.items() }
+
+cdef inline bint collecting(stats):
+    return stats is not None or _counters is not None
+
+cdef record(str kind, dict call_stats, dict stats):
+    if stats is not None:
+        stats.update(call_stats)
+    if _counters is not None:
+        totals = _counters[kind]
+        totals['calls'] = totals.get('calls', 0) + 1
+        for key, value in call_stats.items():
+            totals[key] = totals.get(key, 0) + value
+
 def format_array(arr, col=3):
     if arr is None:
         return None
@@ -194,13 +309,248 @@ def format_array(arr, col=3):
         arr = arr.reshape((len(arr) // col, col))
     return arr
 
+cdef DracoPy.ArrayView array_view(arr, list keepalive) except *:
+    """
+    Borrows a C-contiguous view of arr in its own dtype. Only
+    non-contiguous or byte-swapped inputs are copied. The array
+    backing the view is appended to keepalive.
+    """
+    cdef DracoPy.ArrayView view
+    cdef cnp.ndarray contiguous
+    arr = np.ascontiguousarray(arr)
+    if not arr.dtype.isnative:
+        arr = arr.astype(arr.dtype.newbyteorder('='))
+    if np.issubdtype(arr.dtype, np.floating) and arr.dtype not in (np.float32, np.float64):
+        arr = arr.astype(np.float32)
+
+    data_type = DATA_TYPES.get(arr.dtype)
+    if data_type is None:
+        raise ValueError(f"Unsupported data type: {arr.dtype}")
+
+    contiguous = arr
+    keepalive.append(contiguous)
+    view.data = cnp.PyArray_DATA(contiguous)
+    view.num_rows = arr.shape[0]
+    view.num_components = arr.shape[1] if arr.ndim > 1 else 1
+    view.data_type = data_type
+    return view
+
+WELD_MODES = {
+    None: DracoPy.weld_mode.weld_draco,
+    'none': DracoPy.weld_mode.weld_none,
+    'exact': DracoPy.weld_mode.weld_exact,
+    'quantized': DracoPy.weld_mode.weld_quantized,
+}
+
+POINT_ORDERS = {
+    None: DracoPy.point_order_mode.order_input,
+    'morton': DracoPy.point_order_mode.order_morton,
+    'hilbert': DracoPy.point_order_mode.order_hilbert,
+}
+
+POINT_ORDER_NAMES = { mode: name for name, mode in POINT_ORDERS.items() if name }
+
+# Point cloud encoding methods, as in draco::PointCloudEncodingMethod.
+ENCODING_METHODS = {
+    None: -1,
+    'sequential': 0,
+    'kd_tree': 1,
+}
+
+ATTRIBUTE_OPTIONS = ('quantization_bits', 'quantization_origin', 'quantization_range', 'prediction_scheme')
+
+cdef DracoPy.AttributeOptions native_attribute_options(key, options, dict generic_indices) except *:
+    cdef DracoPy.AttributeOptions native
+    unknown = set(options) - set(ATTRIBUTE_OPTIONS)
+    if unknown:
+        raise ValueError(f"Unknown attribute options {sorted(unknown)}, expected some of {list(ATTRIBUTE_OPTIONS)}")
+
+    native.attribute_type = -1
+    native.generic_index = -1
+    if isinstance(key, AttributeType):
+        native.attribute_type = key
+    elif key in generic_indices:
+        native.generic_index = generic_indices[key]
+    else:
+        raise ValueError(f"Attribute options for {key!r} match no AttributeType nor generic attribute")
+
+    native.quantization_bits = options.get('quantization_bits', -1)
+    origin = options.get('quantization_origin')
+    if origin is not None:
+        native.quantization_origin = np.asarray(origin, dtype=np.float32).ravel()
+    native.quantization_range = options.get('quantization_range', -1)
+    native.prediction_scheme = options.get('prediction_scheme', PredictionScheme.UNDEFINED)
+    return native
+
+cdef class EncodeJob:
+    """
+    Validated encode() arguments described as a native EncodeInput so
+    that the encode itself can run without the GIL. The input arrays
+    are borrowed, not copied, and are kept alive by the job. See
+    encode() for the meaning of each argument.
+    """
+    cdef DracoPy.EncodeInput input
+    cdef list arrays
+
+    def __init__(
+        self, points, faces=None,
+        quantization_bits=14, compression_level=1,
+        quantization_range=-1, quantization_origin=None,
+        create_metadata=False, preserve_order=False,
+        colors=None, tex_coord=None, normals=None,
+        generic_attributes=None, weld=None, attribute_options=None,
+        point_order=None, encoding_method=None, store_permutation=False
+    ):
+        cdef DracoPy.ArrayView view
+
+        # Settings by attribute type first, so that those of a single
+        # generic attribute override them. Keys are told apart by their
+        # class since AttributeType values equal small unique ids.
+        attribute_options = sorted(
+            (attribute_options or {}).items(),
+            key=lambda item: not isinstance(item[0], AttributeType)
+        )
+        for i, (key, options) in enumerate(attribute_options):
+            if key is AttributeType.POSITION:
+                # Positions are quantized through the regular arguments.
+                options = dict(options)
+                quantization_bits = options.pop('quantization_bits', quantization_bits)
+                quantization_origin = options.pop('quantization_origin', quantization_origin)
+                quantization_range = options.pop('quantization_range', quantization_range)
+                attribute_options[i] = (key, options)
+
+        assert 0 <= compression_level <= 10, "Compression level must be in range [0, 10]"
+        if weld not in WELD_MODES:
+            raise ValueError(f"Weld must be one of {list(WELD_MODES)}, got {weld!r}")
+        if point_order not in POINT_ORDERS:
+            raise ValueError(f"Point order must be one of {list(POINT_ORDERS)}, got {point_order!r}")
+        if encoding_method not in ENCODING_METHODS:
+            raise ValueError(f"Encoding method must be one of {list(ENCODING_METHODS)}, got {encoding_method!r}")
+        if faces is not None and (point_order or encoding_method or store_permutation):
+            raise ValueError("point_order, encoding_method and store_permutation only apply to point clouds")
+        if encoding_method == 'kd_tree' and (point_order or preserve_order):
+            raise ValueError("The kd-tree encoding reorders points; use encoding_method='sequential' to keep an order")
+
+        # @zeruniverse Draco supports quantization_bits 1 to 30, see following link:
+        # https://github.com/google/draco/blob/master/src/draco/attributes/attribute_quantization_transform.cc#L107
+        assert 0 <= quantization_bits <= 30, "Quantization bits must be in range [0, 30]"
+
+        points = format_array(points)
+        faces = format_array(faces)
+        colors = format_array(colors)
+        tex_coord = format_array(tex_coord, col=2)
+        normals = format_array(normals, col=3)
+
+        self.arrays = []
+        self.input.is_mesh = faces is not None
+        self.input.quantization_bits = quantization_bits
+        self.input.compression_level = compression_level
+        self.input.quantization_range = quantization_range
+        self.input.preserve_order = preserve_order
+        self.input.create_metadata = create_metadata
+        self.input.weld = WELD_MODES[weld]
+        self.input.point_order = POINT_ORDERS[point_order]
+        self.input.encoding_method = ENCODING_METHODS[encoding_method]
+        self.input.store_permutation = store_permutation
+        self.input.num_threads = 0
+        self.input.collect_stats = False
+
+        # Process generic attributes from generic_attributes
+        generic_indices = {}
+        if generic_attributes:
+            for id_or_name, attr_data in generic_attributes.items():
+                if type(id_or_name) not in (int, str):
+                    raise ValueError(f"Generic attribute keys must be integers or strings")
+                if type(id_or_name) == int and id_or_name < 0:
+                    raise ValueError(f"Generic attribute IDs must be positive integers")
+
+                if attr_data is None:
+                    continue
+                    
+                # Format the attribute data
+                attr_array = format_array(attr_data)
+                if attr_array is None:
+                    continue
+                    
+                # Validate attribute array
+                if len(attr_array.shape) != 2:
+                    raise ValueError(f"Attribute '{id_or_name}' must be 2D array")
+                if attr_array.shape[0] != points.shape[0]:
+                    raise ValueError(f"Attribute '{id_or_name}' must have same number of vertices as points")
+                
+                # Integers keep their width; floats are stored as float32
+                # (doubles are narrowed in C++ while the mesh is built).
+                try:
+                    view = array_view(attr_array, self.arrays)
+                except ValueError:
+                    raise ValueError(f"Unsupported data type for attribute '{id_or_name}': {attr_array.dtype}")
+
+                generic_indices[id_or_name] = self.input.attr_data.size()
+                if type(id_or_name) == int:
+                    self.input.unique_ids.push_back(id_or_name)
+                    self.input.attr_names.push_back(b"")
+                else:
+                    self.input.unique_ids.push_back(-1)
+                    self.input.attr_names.push_back(id_or_name.encode('utf-8'))
+                self.input.attr_data.push_back(view)
+
+        if quantization_origin is not None:
+            self.input.quantization_origin = np.asarray(quantization_origin, dtype=np.float32)[:3]
+        else:
+            self.input.quantization_origin = np.min(points, axis=0).astype(np.float32)
+
+        # Integer points are encoded as int32 / uint32, floats as float32.
+        if points.dtype in (np.int64, np.uint64) and points.size:
+            narrowed = np.iinfo(np.int32 if points.dtype == np.int64 else np.uint32)
+            if points.min() < narrowed.min or points.max() > narrowed.max:
+                raise ValueError(f"{points.dtype} points must fit in {narrowed.dtype} to be encoded losslessly; convert them to float to quantize them")
+        self.input.points = array_view(points, self.arrays)
+
+        self.input.colors.num_components = 0
+        if colors is not None:
+            assert np.issubdtype(colors.dtype, np.uint8), "Colors must be uint8"
+            assert len(colors.shape) == 2, "Colors must be 2D"
+            assert 1 <= colors.shape[1] <= 127, "Number of color channels must be in range [1, 127]"
+            if colors.shape[0] != points.shape[0]:
+                raise ValueError("Colors must have same number of vertices as points")
+            self.input.colors = array_view(colors, self.arrays)
+
+        self.input.tex_coord.num_components = 0
+        if tex_coord is not None:
+            assert np.issubdtype(tex_coord.dtype, float), "Tex coord must be float"
+            assert len(tex_coord.shape) == 2, "Tex coord must be 2D"
+            assert 1 <= tex_coord.shape[1] <= 127, "Number of tex coord channels must be in range [1, 127]"
+            if tex_coord.shape[0] != points.shape[0]:
+                raise ValueError("Tex coord must have same number of vertices as points")
+            self.input.tex_coord = array_view(tex_coord, self.arrays)
+
+        self.input.normals.num_components = 0
+        if normals is not None:
+            assert np.issubdtype(normals.dtype, float), "Normals must be float"
+            assert normals.shape[1] == 3, "Normals must have 3 components"
+            if normals.shape[0] != points.shape[0]:
+                raise ValueError("Normals must have same number of vertices as points")
+            self.input.normals = array_view(normals, self.arrays)
+
+        self.input.faces.num_rows = 0
+        if faces is not None:
+            # Checked before the indices are narrowed to uint32.
+            if faces.size and (faces.min() < 0 or faces.max() >= points.shape[0]):
+                raise ValueError("Faces must reference vertices in the range [0, number of points)")
+            self.input.faces = array_view(faces, self.arrays)
+
+        for key, options in attribute_options:
+            if options:
+                self.input.attribute_options.push_back(native_attribute_options(key, options, generic_indices))
+
 def encode(
     points, faces=None,
     quantization_bits=14, compression_level=1,
     quantization_range=-1, quantization_origin=None,
     create_metadata=False, preserve_order=False,
     colors=None, tex_coord=None, normals=None,
-    generic_attributes=None
+    generic_attributes=None, attribute_options=None, weld=None,
+    point_order=None, encoding_method=None, store_permutation=False, stats=None
 ) -> bytes:
     """
     bytes encode(
@@ -209,7 +559,8 @@ def encode(
         quantization_range=-1, quantization_origin=None,
         create_metadata=False, preserve_order=False,
         colors=None, tex_coord=None, normals=None,
-        generic_attributes=None
+        generic_attributes=None, attribute_options=None, weld=None,
+        point_order=None, encoding_method=None, store_permutation=False, stats=None
     )
 
     Encode a list or numpy array of points/vertices (float) and faces
@@ -243,8 +594,56 @@ def encode(
        - Values: numpy arrays with shape (N, K) where:
          - N = number of vertices in the mesh
          - K = number of components per attribute
-       - Supported data types: float, uint8, uint16, uint32
+       - Supported data types: float, bool and signed or unsigned integers
+         of 8, 16, 32 or 64 bits. Integers keep their width; floats are
+         stored as float32.
        - Use None if there are no generic attributes to encode.
+    Attribute_options sets encoder options per attribute. Keys are an
+        AttributeType (applies to every attribute of that type) or a key of
+        generic_attributes (applies to that attribute only, over its type's
+        settings). Values are dicts with any of:
+         - quantization_bits: 1 to 30, for float attributes. Other than
+           positions, attributes are stored losslessly by default.
+         - quantization_origin, quantization_range: an explicit grid, one
+           origin value per component.
+         - prediction_scheme: a PredictionScheme valid for the attribute.
+        Options for AttributeType.POSITION replace the quantization
+        arguments above. The choices are recorded in the attribute metadata
+        and reported by decode() as the attribute's 'encoding_options'.
+
+        @example
+        ```python
+        attribute_options = {
+            AttributeType.NORMAL: { "quantization_bits": 8 },
+            "curvature": { "quantization_bits": 10, "prediction_scheme": PredictionScheme.DIFFERENCE },
+        }
+        ```
+    Weld selects how duplicate mesh vertices are merged when preserve_order
+        is False. None lets Draco deduplicate the built mesh. 'exact' merges
+        vertices whose values are all identical, and 'quantized' also those
+        whose positions fall on the same quantization grid cell, on the raw
+        arrays before the mesh is built: a parallel sort of vertex hashes,
+        faster and leaner than Draco's pass. Welding drops vertices that no
+        face uses. 'none' skips deduplication. The number of merged vertices
+        is reported in stats as welded_vertices.
+    Point_order, for point clouds, sorts the points along a 'morton'
+        (Z-order) or 'hilbert' curve through their bounding box, in
+        parallel in C++, and encodes them sequentially in that order.
+        Consecutive points of the decoded cloud are then close in space;
+        see DracoPointCloud.block_bounds().
+    Encoding_method, for point clouds, picks 'kd_tree' or 'sequential'
+        encoding. None uses sequential encoding when preserve_order or
+        point_order is set and lets Draco choose otherwise. The kd-tree
+        encoding compresses best but decodes points in an order of its own.
+    Store_permutation, for point clouds, stores the input index of every
+        point as a uint32 attribute named 'point_permutation', returned by
+        DracoPointCloud.point_permutation after decoding.
+    Stats, when a dict, is filled with the seconds spent in each stage:
+        marshal (validating the inputs), build (the draco geometry),
+        draco (Draco's encoder) and copy (into bytes); and with the
+        uncompressed_bytes of the inputs, the compressed_bytes of the
+        output, the native_bytes of the draco geometry and the
+        allocated_bytes of the whole call. See also enable_counters().
 
         @example
         ```python
@@ -263,186 +662,1659 @@ def encode(
         }
         ```
     """
-    assert 0 <= compression_level <= 10, "Compression level must be in range [0, 10]"
+    cdef EncodeJob job
+    cdef DracoPy.EncodeInput *native_input
+    cdef DracoPy.EncodedObject encoded
+    collect = collecting(stats)
+
+    start = time.perf_counter() if collect else 0
+    job = EncodeJob(
+        points, faces,
+        quantization_bits, compression_level,
+        quantization_range, quantization_origin,
+        create_metadata, preserve_order,
+        colors, tex_coord, normals,
+        generic_attributes, weld, attribute_options,
+        point_order, encoding_method, store_permutation
+    )
+    native_input = &job.input
+    native_input.collect_stats = collect
+    marshal = time.perf_counter() - start if collect else 0
+
+    with nogil:
+        encoded = DracoPy.encode_input(native_input[0])
+    if not collect:
+        return encoded_bytes(encoded)
+
+    start = time.perf_counter()
+    binary = encoded_bytes(encoded)
+    record('encode', encode_stats(encoded.stats, job, marshal, time.perf_counter() - start, len(binary)), stats)
+    return binary
+
+cdef dict encode_stats(const DracoPy.NativeStats &native, EncodeJob job, double marshal, double copy, size_t compressed_bytes):
+    return {
+        'marshal': marshal,
+        'build': native.build,
+        'draco': native.draco,
+        'copy': copy,
+        'uncompressed_bytes': sum(arr.nbytes for arr in job.arrays),
+        'compressed_bytes': compressed_bytes,
+        'native_bytes': native.native_bytes,
+        'allocated_bytes': native.native_bytes + compressed_bytes,
+        'welded_vertices': native.welded_vertices,
+    }
+
+cdef bytes encoded_bytes(DracoPy.EncodedObject &encoded):
+    if encoded.encode_status == DracoPy.encoding_status.successful_encoding:
+        return PyBytes_FromStringAndSize(encoded.buffer.data(), encoded.buffer.size())
+    elif encoded.encode_status == DracoPy.encoding_status.failed_during_encoding:
+        raise EncodingFailedException('Invalid mesh')
 
-    # @zeruniverse Draco supports quantization_bits 1 to 30, see following link:
-    # https://github.com/google/draco/blob/master/src/draco/attributes/attribute_quantization_transform.cc#L107
-    assert 0 <= quantization_bits <= 30, "Quantization bits must be in range [0, 30]"
+def encode_many(objects, int threads=0, **kwargs) -> list:
+    """
+    list[bytes] encode_many(objects, threads=0, **kwargs)
 
-    points = format_array(points)
-    faces = format_array(faces)
-    colors = format_array(colors)
-    tex_coord = format_array(tex_coord, col=2)
-    normals = format_array(normals, col=3)
-
-
-    # Process generic attributes from generic_attributes
-    cdef vector[int8_t] unique_ids
-    cdef vector[vector[float]] attr_float_data
-    cdef vector[vector[uint8_t]] attr_uint8_data
-    cdef vector[vector[uint16_t]] attr_uint16_data
-    cdef vector[vector[uint32_t]] attr_uint32_data
-    cdef vector[int] attr_data_types  # 0=float, 1=uint8, 2=uint16, 3=uint32
-    cdef vector[int] attr_num_components
-    cdef vector[string] attr_names
-
-    if generic_attributes:
-        for id_or_name, attr_data in generic_attributes.items():
-            if type(id_or_name) not in (int, str):
-                raise ValueError(f"Generic attribute keys must be integers or strings")
-            if type(id_or_name) == int and id_or_name < 0:
-                raise ValueError(f"Generic attribute IDs must be positive integers")
-
-            if attr_data is None:
-                continue
-                
-            # Format the attribute data
-            attr_array = format_array(attr_data)
-            if attr_array is None:
-                continue
-                
-            # Validate attribute array
-            if len(attr_array.shape) != 2:
-                raise ValueError(f"Attribute '{id_or_name}' must be 2D array")
-            if attr_array.shape[0] != points.shape[0]:
-                raise ValueError(f"Attribute '{id_or_name}' must have same number of vertices as points")
-            
-            if type(id_or_name) == int:
-                unique_ids.push_back(id_or_name)
-                attr_names.push_back("")
-            else:
-                unique_ids.push_back(-1)
-                attr_names.push_back(id_or_name.encode('utf-8'))
-
-            # Store attribute info
-            attr_num_components.push_back(attr_array.shape[1])
-            
-            # Handle different data types
-            if np.issubdtype(attr_array.dtype, np.floating):
-                attr_data_types.push_back(DataType.DT_FLOAT32)  # 9, float
-                attr_array = attr_array.astype(np.float32)
-                float_view = attr_array.reshape((attr_array.size,))
-                attr_float_data.push_back(float_view)
-            elif attr_array.dtype == np.uint8:
-                attr_data_types.push_back(DataType.DT_UINT8)  # 2, uint8
-                uint8_view = attr_array.reshape((attr_array.size,))
-                attr_uint8_data.push_back(uint8_view)
-            elif attr_array.dtype == np.uint16:
-                attr_data_types.push_back(DataType.DT_UINT16)  # 4, uint16
-                uint16_view = attr_array.reshape((attr_array.size,))
-                attr_uint16_data.push_back(uint16_view)
-            elif attr_array.dtype == np.uint32:
-                attr_data_types.push_back(DataType.DT_UINT32)  # 6, uint32
-                uint32_view = attr_array.reshape((attr_array.size,))
-                attr_uint32_data.push_back(uint32_view)
-            else:
-                raise ValueError(f"Unsupported data type for attribute '{id_or_name}': {attr_array.dtype}")
-
-            # Add empty vectors for other types
-            attr_float_data.push_back(vector[float]())
-            attr_uint8_data.push_back(vector[uint8_t]())
-            attr_uint16_data.push_back(vector[uint16_t]())
-
-    integer_mark = 0
-
-    if np.issubdtype(points.dtype, np.signedinteger):
-        integer_mark = 1
-    elif np.issubdtype(points.dtype, np.unsignedinteger):
-        integer_mark = 2
-
-    cdef cnp.ndarray[float, ndim=1] qorigin = np.zeros((3,), dtype=np.float32)
-    cdef float[:] quant_origin = qorigin
-
-    if quantization_origin is not None:
-        qorigin[:] = quantization_origin[:]
-    else:
-        qorigin[:] = np.min(points, axis=0)
-
-    cdef vector[float] pointsview = points.reshape((points.size,))
-    cdef vector[uint32_t] facesview
-    cdef vector[uint8_t] colorsview
-    cdef vector[float] texcoordview
-    cdef vector[float] normalsview
-
-
-    colors_channel = 0
-    if colors is not None:
-        assert np.issubdtype(colors.dtype, np.uint8), "Colors must be uint8"
-        assert len(colors.shape) == 2, "Colors must be 2D"
-        colors_channel = colors.shape[1]
-        assert 1 <= colors_channel <= 127, "Number of color channels must be in range [1, 127]"
-        colorsview = colors.reshape((colors.size,))
-
-    tex_coord_channel = 0
-    if tex_coord is not None:
-        assert np.issubdtype(tex_coord.dtype, float), "Tex coord must be float"
-        assert len(tex_coord.shape) == 2, "Tex coord must be 2D"
-        tex_coord_channel = tex_coord.shape[1]
-        assert 1 <= tex_coord_channel <= 127, "Number of tex coord channels must be in range [1, 127]"
-        texcoordview = tex_coord.reshape((tex_coord.size,))
-
-
-    has_normals = 0
-    if normals is not None:
-        assert np.issubdtype(normals.dtype, float), "Normals must be float"
-        assert normals.shape[1] == 3, "Normals must have 3 components"
-        has_normals = 1
-        normalsview = normals.reshape((normals.size,))
+    Encode a batch of meshes and/or point clouds on a native thread pool.
+    The GIL is held only while each input is validated, the Draco
+    encodes themselves run concurrently.
 
-    if faces is None:
-        encoded = DracoPy.encode_point_cloud(
-            pointsview, quantization_bits, compression_level,
-            quantization_range, <float*>&quant_origin[0],
-            preserve_order, create_metadata, integer_mark,
-            colorsview, colors_channel,
-            unique_ids, attr_float_data, attr_uint8_data,
-            attr_uint16_data, attr_uint32_data,
-            attr_data_types, attr_num_components,
-            attr_names
+    Each element of objects is either a dict of encode() keyword
+    arguments or a (points, faces) tuple. Keyword arguments given to
+    encode_many are shared defaults that a dict element may override.
+    Threads is the pool size; 0 uses one thread per core.
+
+    Returns the encoded buffers in the same order as objects.
+    """
+    collect = collecting(None)
+    jobs = []
+    marshal = []
+    for obj in objects:
+        start = time.perf_counter() if collect else 0
+        if isinstance(obj, dict):
+            jobs.append(EncodeJob(**{ **kwargs, **obj }))
+        else:
+            points, faces = obj
+            jobs.append(EncodeJob(points, faces, **kwargs))
+        if collect:
+            marshal.append(time.perf_counter() - start)
+
+    cdef vector[DracoPy.EncodeInput*] inputs
+    cdef EncodeJob job
+    for job in jobs:
+        job.input.collect_stats = collect
+        job.input.num_threads = 1 if len(jobs) > 1 else threads
+        inputs.push_back(&job.input)
+
+    cdef vector[DracoPy.EncodedObject] encoded
+    with nogil:
+        encoded = DracoPy.encode_inputs(inputs, threads)
+
+    cdef size_t i
+    results = []
+    for i in range(encoded.size()):
+        start = time.perf_counter() if collect else 0
+        results.append(encoded_bytes(encoded[i]))
+        if collect:
+            copy = time.perf_counter() - start
+            record('encode', encode_stats(encoded[i].stats, jobs[i], marshal[i], copy, len(results[i])), None)
+    return results
+
+cdef class Encoder:
+    """
+    Encoder(
+        quantization_bits=14, compression_level=1,
+        quantization_range=-1, quantization_origin=None,
+        create_metadata=False, preserve_order=False, weld=None,
+        attribute_options=None
+    )
+
+    Encodes many meshes or point clouds with the same options, which
+    have the meaning described in encode(). The output buffer is kept
+    between calls, so a stream of small encodes reuses its memory
+    instead of reallocating it, and each result is copied exactly once,
+    into the returned bytes.
+
+    An Encoder may be shared between threads, but its calls take turns
+    on that buffer; give each thread its own Encoder to encode in
+    parallel.
+
+        @example
+        ```python
+        encoder = DracoPy.Encoder(quantization_bits=11)
+        binaries = [ encoder.encode(points, faces) for points, faces in fragments ]
+        ```
+    """
+    cdef DracoPy.EncoderContext *context
+    cdef dict options
+    cdef object lock
+
+    def __cinit__(self, *args, **kwargs):
+        self.context = new DracoPy.EncoderContext()
+        self.lock = threading.Lock()
+
+    def __dealloc__(self):
+        del self.context
+
+    def __init__(
+        self, quantization_bits=14, compression_level=1,
+        quantization_range=-1, quantization_origin=None,
+        create_metadata=False, preserve_order=False, weld=None,
+        attribute_options=None
+    ):
+        self.options = {
+            'quantization_bits': quantization_bits,
+            'compression_level': compression_level,
+            'quantization_range': quantization_range,
+            'quantization_origin': quantization_origin,
+            'create_metadata': create_metadata,
+            'preserve_order': preserve_order,
+            'weld': weld,
+            'attribute_options': attribute_options,
+        }
+
+    def encode(
+        self, points, faces=None,
+        colors=None, tex_coord=None, normals=None,
+        generic_attributes=None, stats=None
+    ) -> bytes:
+        """
+        bytes encode(points, faces=None, colors=None, tex_coord=None,
+            normals=None, generic_attributes=None, stats=None)
+
+        Same as DracoPy.encode() with this encoder's options.
+        """
+        cdef EncodeJob job
+        cdef DracoPy.EncodeInput *native_input
+        cdef DracoPy.EncoderContext *context = self.context
+        cdef DracoPy.encoding_status status
+        collect = collecting(stats)
+
+        start = time.perf_counter() if collect else 0
+        job = EncodeJob(
+            points, faces,
+            colors=colors, tex_coord=tex_coord, normals=normals,
+            generic_attributes=generic_attributes, **self.options
         )
+        native_input = &job.input
+        native_input.collect_stats = collect
+        marshal = time.perf_counter() - start if collect else 0
+
+        # The context's buffer is read until the bytes are built.
+        with self.lock:
+            with nogil:
+                status = context.encode(native_input[0])
+            if status != DracoPy.encoding_status.successful_encoding:
+                raise EncodingFailedException('Invalid mesh')
+            if not collect:
+                return PyBytes_FromStringAndSize(context.data(), context.size())
+
+            start = time.perf_counter()
+            binary = PyBytes_FromStringAndSize(context.data(), context.size())
+            record('encode', encode_stats(context.stats(), job, marshal, time.perf_counter() - start, len(binary)), stats)
+            return binary
+
+def encode_lods(points, faces, levels=(1.0, 0.5, 0.25), int threads=0, **kwargs) -> list:
+    """
+    list[bytes] encode_lods(points, faces, levels=(1.0, 0.5, 0.25), threads=0, **kwargs)
+
+    Encode a level-of-detail pyramid of a mesh in one call. Each entry
+    of levels is the fraction of faces kept at that level, in (0, 1].
+    Coarser levels are simplified in C++ by quadric error decimation
+    restricted to edge collapses onto existing vertices, so every level
+    only uses input vertices with their original attributes.
+
+    All levels are quantized with the same quantization_origin and
+    quantization_range (computed from the full mesh unless given), so
+    vertices shared by two levels decode to identical positions. The
+    levels are encoded in parallel on threads threads (0 uses one
+    thread per core). Other keyword arguments are those of encode().
+
+    Returns the encoded buffers in the same order as levels.
+    """
+    assert faces is not None, "encode_lods requires faces"
+    cdef vector[float] native_levels
+    for level in levels:
+        if not 0 < level <= 1:
+            raise ValueError(f"Levels of detail must be in the range (0, 1], got {level}")
+        native_levels.push_back(level)
+
+    cdef EncodeJob job = EncodeJob(points, faces, **kwargs)
+    cdef DracoPy.EncodeInput *native_input = &job.input
+    cdef vector[DracoPy.EncodedObject] encoded
+    with nogil:
+        encoded = DracoPy.encode_lods(native_input[0], native_levels, threads)
+
+    cdef size_t i
+    results = []
+    for i in range(encoded.size()):
+        results.append(encoded_bytes(encoded[i]))
+    return results
+
+def encode_partitioned(points, faces, grid=(2, 2, 2), int threads=0, vertex_ids=False, **kwargs) -> tuple:
+    """
+    (list[bytes], dict) encode_partitioned(
+        points, faces, grid=(2, 2, 2), threads=0, vertex_ids=False, **kwargs
+    )
+
+    Encode a large mesh as independent cells of a spatial grid, in
+    parallel. The bounding box of the mesh is split into nx * ny * nz
+    cells (grid) and each face goes to the cell holding its centroid.
+    Cells are encoded concurrently on threads threads (0 uses one thread
+    per core), so wall-clock time scales with the number of cores.
+
+    Every cell is quantized with the same quantization_origin and
+    quantization_range (computed from the whole mesh unless given), so a
+    vertex on a seam decodes to exactly the same position in every cell
+    using it. With vertex_ids=True each cell also stores the original index
+    of its vertices in a STREAM_VERTEX_ID attribute, and the buffers can be
+    stitched back into one mesh with decode_chunks(). Other keyword
+    arguments are those of encode().
+
+    Returns the buffers of the non-empty cells and a manifest dict with
+    the grid, the shared quantization (origin, range and bits) and, per
+    buffer, its cell (x, y, z), num_points, num_faces, the bbox of its
+    vertices (min xyz, max xyz) and its size in bytes.
+    """
+    assert faces is not None, "encode_partitioned requires faces"
+    cdef vector[int] native_grid
+    for count in grid:
+        if count < 1:
+            raise ValueError(f"Grid cell counts must be positive, got {tuple(grid)}")
+        native_grid.push_back(count)
+    if native_grid.size() != 3:
+        raise ValueError(f"The grid must have three cell counts, got {tuple(grid)}")
+
+    if vertex_ids:
+        generic_attributes = dict(kwargs.get('generic_attributes') or {})
+        generic_attributes[STREAM_VERTEX_ID] = np.arange(len(format_array(points)), dtype=np.uint32).reshape((-1, 1))
+        kwargs['generic_attributes'] = generic_attributes
+
+    cdef EncodeJob job = EncodeJob(points, faces, **kwargs)
+    cdef DracoPy.EncodeInput *native_input = &job.input
+    cdef DracoPy.PartitionedObject partitioned
+    with nogil:
+        partitioned = DracoPy.encode_partitioned(native_input[0], native_grid, threads)
+
+    cdef size_t i
+    buffers = []
+    cells = []
+    nx, ny = native_grid[0], native_grid[1]
+    for i in range(partitioned.cells.size()):
+        buffers.append(encoded_bytes(partitioned.cells[i]))
+        cell_id = partitioned.cell_ids[i]
+        cells.append({
+            'cell': (cell_id % nx, (cell_id // nx) % ny, cell_id // (nx * ny)),
+            'num_points': partitioned.num_points[i],
+            'num_faces': partitioned.num_faces[i],
+            'bbox': tuple([ partitioned.bounds[6 * i + k] for k in range(6) ]),
+            'size': len(buffers[-1]),
+        })
+
+    manifest = {
+        'grid': tuple(grid),
+        'quantization_origin': list(partitioned.quantization_origin),
+        'quantization_range': partitioned.quantization_range,
+        'quantization_bits': job.input.quantization_bits,
+        'cells': cells,
+    }
+    return buffers, manifest
+
+AUTO_QUANTIZATION_BITS = range(8, 21)
+AUTO_COMPRESSION_LEVELS = range(0, 11)
+
+def sampled_geometry(points, faces, attributes, int sample_size):
+    """
+    A contiguous block of about sample_size faces (or points, for point
+    clouds) from the middle of the input, with the vertices and vertex
+    attributes it uses, and the ratio of the full size to the sample's.
+    """
+    if faces is None:
+        if len(points) <= sample_size:
+            return points, None, attributes, 1.0
+        start = (len(points) - sample_size) // 2
+        rows = np.arange(start, start + sample_size)
+        sample_faces = None
+        ratio = len(points) / sample_size
     else:
-        facesview = faces.reshape((faces.size,))
-        encoded = DracoPy.encode_mesh(
-            pointsview, facesview,
-            quantization_bits, compression_level,
-            quantization_range, &quant_origin[0],
-            preserve_order, create_metadata, integer_mark,
-            colorsview, colors_channel, texcoordview, tex_coord_channel,
-            normalsview, has_normals,
-            unique_ids, attr_float_data, attr_uint8_data,
-            attr_uint16_data, attr_uint32_data,
-            attr_data_types, attr_num_components,
-            attr_names
-        )
+        if len(faces) <= sample_size:
+            return points, faces, attributes, 1.0
+        start = (len(faces) - sample_size) // 2
+        rows, inverse = np.unique(faces[start:start + sample_size], return_inverse=True)
+        sample_faces = inverse.reshape((-1, 3)).astype(np.uint32)
+        ratio = len(faces) / sample_size
+
+    sampled = {}
+    for key, value in attributes.items():
+        if key == 'generic_attributes':
+            sampled[key] = { k: format_array(v)[rows] for k, v in value.items() if v is not None }
+        else:
+            sampled[key] = format_array(value, col=2 if key == 'tex_coord' else 3)[rows]
+    return points[rows], sample_faces, sampled, ratio
 
+def matched_rows(keys, candidates):
+    """
+    Index of a row of candidates equal to each row of keys, -1 where
+    there is none.
+    """
+    ids = np.unique(np.concatenate([ candidates, keys ]), axis=0, return_inverse=True)[1].ravel()
+    lookup = np.full(ids.max() + 1, -1, dtype=np.int64)
+    lookup[ids[:len(candidates)]] = np.arange(len(candidates))
+    return lookup[ids[len(candidates):]]
 
-    if encoded.encode_status == DracoPy.encoding_status.successful_encoding:
-        return bytes(encoded.buffer)
-    elif encoded.encode_status == DracoPy.encoding_status.failed_during_encoding:
-        raise EncodingFailedException('Invalid mesh')
+def position_errors(points, decoded, grid=None):
+    """
+    Distance from each input point to its decoded point, matched by
+    position since Draco may reorder and weld points: the decoded point
+    on the same grid cell (or at the same integer position without a
+    grid), else on a neighbouring cell, as the two quantizers may round
+    a value on a cell boundary differently. Inf where there is none.
+    """
+    points = points.astype(np.float64)
+    decoded = decoded.astype(np.float64)
+    if grid is None:
+        cells, decoded_cells = points.astype(np.int64), decoded.astype(np.int64)
+    else:
+        cells, decoded_cells = grid.quantize_points(points), grid.quantize_points(decoded)
+
+    distance = np.full(len(points), np.inf)
+    def nearest(rows, offset):
+        match = matched_rows(cells[rows] + np.asarray(offset, dtype=cells.dtype), decoded_cells)
+        found = match >= 0
+        rows = rows[found]
+        distance[rows] = np.minimum(distance[rows], np.linalg.norm(decoded[match[found]] - points[rows], axis=1))
+
+    nearest(np.arange(len(points)), (0, 0, 0))
+    unmatched = np.flatnonzero(np.isinf(distance))
+    if grid is not None and len(unmatched):
+        for offset in [ (x, y, z) for x in (-1, 0, 1) for y in (-1, 0, 1) for z in (-1, 0, 1) if x or y or z ]:
+            nearest(unmatched, offset)
+    return distance
+
+def encode_auto(
+    points, faces=None, max_error=None, max_bytes=None, max_encode_ms=None,
+    int sample_size=50000, int threads=0, **kwargs
+) -> tuple:
+    """
+    (bytes, dict) encode_auto(
+        points, faces=None, max_error=None, max_bytes=None, max_encode_ms=None,
+        sample_size=50000, threads=0, **kwargs
+    )
+
+    Chooses quantization_bits and compression_level for a size, error or
+    latency budget, then encodes the whole mesh (or point cloud) with them.
+
+    Max_error bounds the distance between any input position and its
+    decoded position. Max_bytes bounds the encoded size and max_encode_ms
+    the encode time. Any combination may be given.
+
+    Each (quantization_bits, compression_level) pair is trial-encoded on a
+    block of sample_size faces (points for point clouds) taken from the
+    middle of the input. The trials run in parallel on threads threads
+    (0 uses one thread per core). Sizes and times are extrapolated to the
+    full input. Among the pairs that fit the budget, the fewest bits
+    meeting max_error are used if it is given, otherwise the most bits.
+    Ties go to the smallest output. When nothing fits, the pair
+    overrunning its budget by the smallest factor is used.
+
+    Other keyword arguments are those of encode(); quantization_bits and
+    compression_level are chosen here.
+
+    Returns the encoded bytes and a report dict with:
+        quantization_bits, compression_level: the chosen parameters
+        encoded_bytes, encode_ms: achieved on the full input
+        max_error, rms_error: distances between the input positions and
+            those of the encoded bytes decoded again, matched by position
+            unless preserve_order keeps the input order
+        met: whether the budget was met
+        trials: the estimates of every pair tried
+    """
+    for name in ('quantization_bits', 'compression_level'):
+        if name in kwargs:
+            raise ValueError(f"encode_auto chooses {name} itself")
+
+    points = format_array(points)
+    faces = format_array(faces)
+    attributes = { key: kwargs.pop(key) for key in ('colors', 'tex_coord', 'normals', 'generic_attributes') if kwargs.get(key) is not None }
+    quantized = not np.issubdtype(points.dtype, np.integer)
+
+    # The grid Draco would derive, made explicit so errors can be measured.
+    origin = kwargs.pop('quantization_origin', None)
+    origin = np.asarray(origin if origin is not None else points.min(axis=0), dtype=np.float32)[:3]
+    extent = kwargs.pop('quantization_range', -1)
+    if extent <= 0:
+        extent = float(np.max(points.max(axis=0).astype(np.float32) - origin)) if len(points) else 0.0
+        extent = extent if extent > 0 else 1.0
+
+    bits_options = list(AUTO_QUANTIZATION_BITS) if quantized else [ 14 ]
+    if quantized and max_error is not None:
+        # Half a grid cell along each axis.
+        cells = np.sqrt(3) / 2 * extent / max_error
+        bits = max(1, int(np.ceil(np.log2(cells + 1))))
+        if bits > 30:
+            raise ValueError(f"max_error={max_error} needs more than 30 quantization bits")
+        bits_options = [ bits ]
+
+    sample_points, sample_faces, sample_attributes, ratio = sampled_geometry(points, faces, attributes, sample_size)
+    jobs = []
+    cdef EncodeJob job
+    for bits in bits_options:
+        for level in AUTO_COMPRESSION_LEVELS:
+            job = EncodeJob(
+                sample_points, sample_faces, quantization_bits=bits, compression_level=level,
+                quantization_origin=origin, quantization_range=extent, **sample_attributes, **kwargs
+            )
+            job.input.collect_stats = True
+            job.input.num_threads = 1
+            jobs.append((bits, level, job))
+
+    cdef vector[DracoPy.EncodeInput*] inputs
+    for _, _, job in jobs:
+        inputs.push_back(&job.input)
+    cdef vector[DracoPy.EncodedObject] encoded
+    with nogil:
+        encoded = DracoPy.encode_inputs(inputs, threads)
+
+    cdef size_t i
+    trials = []
+    for i in range(encoded.size()):
+        bits, level, _ = jobs[i]
+        trial = {
+            'quantization_bits': bits,
+            'compression_level': level,
+            'estimated_bytes': len(encoded_bytes(encoded[i])) * ratio,
+            'estimated_ms': (encoded[i].stats.build + encoded[i].stats.draco) * 1e3 * ratio,
+        }
+        overrun = 1.0
+        if max_bytes is not None:
+            overrun = max(overrun, trial['estimated_bytes'] / max_bytes)
+        if max_encode_ms is not None:
+            overrun = max(overrun, trial['estimated_ms'] / max_encode_ms)
+        trial['overrun'] = overrun
+        trials.append(trial)
+
+    precision = 1 if max_error is not None else -1
+    best = min(trials, key=lambda t: (t['overrun'], precision * t['quantization_bits'], t['estimated_bytes']))
+
+    stats = {}
+    binary = encode(
+        points, faces, quantization_bits=best['quantization_bits'], compression_level=best['compression_level'],
+        quantization_origin=origin, quantization_range=extent, stats=stats, **attributes, **kwargs
+    )
+
+    max_distance = rms_distance = 0.0
+    if len(points):
+        decoded = decode(binary, attributes=[ AttributeType.POSITION ]).points
+        if kwargs.get('preserve_order') and not kwargs.get('point_order') and len(decoded) == len(points):
+            distance = np.linalg.norm(decoded.astype(np.float64) - points, axis=1)
+        else:
+            grid = EncodingOptions(best['quantization_bits'], extent, origin) if quantized else None
+            distance = position_errors(points, decoded, grid)
+        max_distance = float(distance.max())
+        rms_distance = float(np.sqrt(np.mean(distance ** 2)))
+
+    encode_ms = (stats['marshal'] + stats['build'] + stats['draco'] + stats['copy']) * 1e3
+    met = (
+        (max_error is None or max_distance <= max_error)
+        and (max_bytes is None or len(binary) <= max_bytes)
+        and (max_encode_ms is None or encode_ms <= max_encode_ms)
+    )
+    return binary, {
+        'quantization_bits': best['quantization_bits'],
+        'compression_level': best['compression_level'],
+        'encoded_bytes': len(binary),
+        'encode_ms': encode_ms,
+        'max_error': max_distance,
+        'rms_error': rms_distance,
+        'met': met,
+        'trials': trials,
+    }
+
+STREAM_VERTEX_ID = "draco_stream_vertex_id"
+
+class StreamEncoder:
+    """
+    StreamEncoder(
+        chunk_faces=1000000,
+        quantization_bits=14, compression_level=1,
+        quantization_range=-1, quantization_origin=None,
+        preserve_order=False, threads=0
+    )
 
-def raise_decoding_error(decoding_status):
+    Encodes a mesh that is too large to build in one piece as a sequence
+    of independently decodable Draco chunks, split by face ranges.
+
+    Vertex blocks are pushed with add_vertices() and face blocks, which
+    index all vertices pushed so far, with add_faces(). Every time
+    chunk_faces faces are pending they are encoded, together with only
+    the vertices they reference, and returned. finish() returns the
+    last, partial chunk.
+
+    All chunks are quantized on the same grid, so a vertex shared by two
+    chunks decodes to the same position in both. Each chunk also stores
+    the global index of its vertices in a uint32 generic attribute named
+    STREAM_VERTEX_ID, which decode_chunks() uses to stitch them back
+    together.
+
+    Vertex blocks are kept by reference (an np.memmap stays on disk) and
+    face blocks are released once encoded. The quantization grid must be
+    known when the first chunk is written: either pass quantization_origin
+    and quantization_range, or push every vertex before the faces and the
+    grid is taken from their bounds.
+
+    Other arguments have the same meaning as in encode(); threads is the
+    pool size used when several chunks are ready at once.
+    """
+    def __init__(
+        self, chunk_faces=1000000,
+        quantization_bits=14, compression_level=1,
+        quantization_range=-1, quantization_origin=None,
+        preserve_order=False, threads=0
+    ):
+        assert chunk_faces > 0, "chunk_faces must be positive"
+        self.chunk_faces = int(chunk_faces)
+        self.threads = threads
+        self.options = {
+            'quantization_bits': quantization_bits,
+            'compression_level': compression_level,
+            'preserve_order': preserve_order,
+        }
+        self.quantization_range = quantization_range
+        self.quantization_origin = None
+        if quantization_origin is not None:
+            self.quantization_origin = np.asarray(quantization_origin, dtype=np.float32)[:3]
+
+        self.num_vertices = 0
+        self.num_chunks = 0
+        self._blocks = []
+        self._offsets = []
+        self._pending = []
+        self._num_pending = 0
+        self._bounds_min = None
+        self._bounds_max = None
+
+    @property
+    def grid_fixed(self):
+        return self.num_chunks > 0
+
+    def add_vertices(self, points, colors=None, tex_coord=None, normals=None, generic_attributes=None):
+        """
+        Appends a block of vertices. The optional per-vertex attributes
+        must be the same for every block.
+        """
+        block = {
+            'points': format_array(points),
+            'colors': format_array(colors),
+            'tex_coord': format_array(tex_coord, col=2),
+            'normals': format_array(normals, col=3),
+            'generic_attributes': {
+                key: format_array(values)
+                for key, values in (generic_attributes or {}).items()
+            },
+        }
+        num_points = block['points'].shape[0]
+        for key in ('colors', 'tex_coord', 'normals'):
+            if block[key] is not None and block[key].shape[0] != num_points:
+                raise ValueError(f"{key} must have same number of vertices as points")
+        for key, values in block['generic_attributes'].items():
+            if key == STREAM_VERTEX_ID:
+                raise ValueError(f"Generic attribute name {STREAM_VERTEX_ID} is reserved")
+            if values.shape[0] != num_points:
+                raise ValueError(f"Attribute '{key}' must have same number of vertices as points")
+
+        if self._blocks:
+            first = self._blocks[0]
+            same_layout = all(
+                (block[key] is None) == (first[key] is None)
+                for key in ('colors', 'tex_coord', 'normals')
+            ) and block['generic_attributes'].keys() == first['generic_attributes'].keys()
+            if not same_layout:
+                raise ValueError("Every vertex block must carry the same attributes")
+
+        if num_points > 0:
+            self._update_bounds(block['points'])
+        self._blocks.append(block)
+        self._offsets.append(self.num_vertices)
+        self.num_vertices += num_points
+
+    def add_faces(self, faces) -> list:
+        """
+        Appends a block of faces indexing the vertices pushed so far.
+        Returns the chunks (list of bytes) completed by this block.
+        """
+        faces = format_array(faces)
+        if faces.size and faces.max() >= self.num_vertices:
+            raise ValueError("Faces reference vertices that have not been added yet")
+        self._pending.append(faces)
+        self._num_pending += faces.shape[0]
+
+        if self._num_pending < self.chunk_faces:
+            return []
+
+        pending = np.concatenate(self._pending)
+        num_full = (pending.shape[0] // self.chunk_faces) * self.chunk_faces
+        self._pending = [ pending[num_full:] ]
+        self._num_pending = pending.shape[0] - num_full
+        return self._encode_chunks([
+            pending[start:start + self.chunk_faces]
+            for start in range(0, num_full, self.chunk_faces)
+        ])
+
+    def finish(self) -> list:
+        """Encodes the faces still pending and returns their chunk, if any."""
+        if self._num_pending == 0:
+            return []
+        pending = np.concatenate(self._pending)
+        self._pending = []
+        self._num_pending = 0
+        return self._encode_chunks([ pending ])
+
+    def _update_bounds(self, points):
+        bounds_min = np.min(points, axis=0)
+        bounds_max = np.max(points, axis=0)
+        if self._bounds_min is not None:
+            bounds_min = np.minimum(self._bounds_min, bounds_min)
+            bounds_max = np.maximum(self._bounds_max, bounds_max)
+        if self.grid_fixed:
+            self._check_grid(bounds_min, bounds_max)
+        self._bounds_min, self._bounds_max = bounds_min, bounds_max
+
+    def _check_grid(self, bounds_min, bounds_max):
+        if self.quantization_origin is None or self.quantization_range <= 0:
+            return
+        if not (
+            np.all(bounds_min >= self.quantization_origin)
+            and np.all(bounds_max <= self.quantization_origin + self.quantization_range)
+        ):
+            raise ValueError("Vertices fall outside the quantization grid shared by the chunks")
+
+    def _fix_grid(self):
+        if self.quantization_origin is None:
+            self.quantization_origin = self._bounds_min.astype(np.float32)
+        if self.quantization_range <= 0:
+            extent = self._bounds_max.astype(np.float32) - self.quantization_origin
+            self.quantization_range = float(np.max(extent)) or 1.0
+        else:
+            self._check_grid(self._bounds_min, self._bounds_max)
+
+    def _gather(self, ids, block_index, key, generic=False):
+        first = self._blocks[0]['generic_attributes' if generic else key]
+        if generic:
+            first = first[key]
+        out = np.empty((ids.shape[0],) + first.shape[1:], dtype=first.dtype)
+        for b in np.unique(block_index):
+            mask = block_index == b
+            block = self._blocks[b]
+            values = block['generic_attributes'][key] if generic else block[key]
+            out[mask] = values[ids[mask] - self._offsets[b]]
+        return out
+
+    def _chunk(self, faces):
+        ids, local_faces = np.unique(faces, return_inverse=True)
+        block_index = np.searchsorted(self._offsets, ids, side='right') - 1
+        first = self._blocks[0]
+
+        chunk = {
+            'points': self._gather(ids, block_index, 'points'),
+            'faces': local_faces.reshape(faces.shape).astype(np.uint32),
+            'quantization_origin': self.quantization_origin,
+            'quantization_range': self.quantization_range,
+        }
+        for key in ('colors', 'tex_coord', 'normals'):
+            if first[key] is not None:
+                chunk[key] = self._gather(ids, block_index, key)
+
+        generic_attributes = {
+            key: self._gather(ids, block_index, key, generic=True)
+            for key in first['generic_attributes']
+        }
+        generic_attributes[STREAM_VERTEX_ID] = ids.astype(np.uint32).reshape((-1, 1))
+        chunk['generic_attributes'] = generic_attributes
+        return chunk
+
+    def _encode_chunks(self, face_blocks):
+        if not self.grid_fixed:
+            self._fix_grid()
+        chunks = [ self._chunk(faces) for faces in face_blocks ]
+        self.num_chunks += len(chunks)
+        return encode_many(chunks, threads=self.threads, **self.options)
+
+def decode_chunks(chunks, lazy=False, int threads=0):
+    """
+    DracoMesh decode_chunks(chunks, lazy=False, threads=0)
+
+    Decodes the chunks written by a StreamEncoder. By default they are
+    decoded on a native thread pool and reassembled into one DracoMesh
+    whose vertices are in their original order. Vertices shared between
+    chunks appear once.
+
+    With lazy=True a generator is returned instead that decodes one chunk
+    at a time. Each chunk keeps its STREAM_VERTEX_ID attribute, which
+    holds the global index of every vertex in it.
+    """
+    if lazy:
+        return (decode(chunk) for chunk in chunks)
+
+    meshes = decode_many(chunks, threads)
+    if not meshes:
+        raise ValueError("No chunks to decode")
+
+    vertex_ids = []
+    for mesh in meshes:
+        vertex_id = mesh.get_attribute_by_name(STREAM_VERTEX_ID)
+        if vertex_id is None:
+            raise ValueError("Chunk was not written by a StreamEncoder")
+        vertex_ids.append(vertex_id['data'][:,0])
+    # Chunks that are all empty stitch into an empty mesh.
+    num_points = max((int(ids.max()) for ids in vertex_ids if ids.size), default=-1) + 1
+
+    first = meshes[0]
+    attributes = []
+    for i, attr in enumerate(first.attributes):
+        if attr['name'] == STREAM_VERTEX_ID:
+            continue
+        data = np.zeros((num_points, attr['num_components']), dtype=attr['data'].dtype)
+        for mesh, ids in zip(meshes, vertex_ids):
+            data[ids] = mesh.attributes[i]['data']
+        attributes.append({ **attr, 'data': data })
+
+    data_struct = dict(first.data_struct)
+    data_struct['attributes'] = attributes
+    data_struct['faces'] = np.concatenate([
+        ids[mesh.faces] for mesh, ids in zip(meshes, vertex_ids)
+    ]).astype(np.uint32)
+    return DracoMesh(data_struct)
+
+def raise_decoding_error(decoding_status, bytes message=b''):
+    reason = message.decode('utf-8', 'replace')
     if decoding_status == DracoPy.decoding_status.not_draco_encoded:
         raise FileTypeException('Input mesh is not draco encoded')
     elif decoding_status == DracoPy.decoding_status.failed_during_decoding:
+        if reason:
+            raise TypeError(f'Failed to decode input mesh. Data might be corrupted: {reason}')
         raise TypeError('Failed to decode input mesh. Data might be corrupted')
     elif decoding_status == DracoPy.decoding_status.no_position_attribute:
         raise ValueError('DracoPy only supports meshes with position attributes')
+    elif decoding_status == DracoPy.decoding_status.exceeds_limits:
+        raise DecodeLimitException(f'Input mesh exceeds the decode limits: {reason}')
 
-def decode(bytes buffer) -> Union[DracoMesh, DracoPointCloud]:
+cdef const unsigned char[::1] readable(buffer) except *:
+    """
+    Borrows the bytes of any C-contiguous buffer-protocol object (bytes,
+    bytearray, memoryview, mmap, NumPy arrays of any dtype) without
+    copying them. The object stays locked while the view is alive.
+    """
+    if isinstance(buffer, str):
+        raise TypeError("Expected a bytes-like object, got str")
+    view = memoryview(buffer)
+    if not view.c_contiguous:
+        raise ValueError("Draco buffers must be C-contiguous")
+    return view.cast('B') if view.format != 'B' or view.ndim != 1 else view
+
+cdef inline const char *buffer_data(const unsigned char[::1] view):
+    if view.shape[0] == 0:
+        return NULL
+    return <const char*>&view[0]
+
+cdef list buffer_views(buffers, vector[DracoPy.BufferView] &views):
+    """
+    Fills views with the bytes of every buffer and returns the borrowed
+    views, which must be kept alive for as long as views is used.
+    """
+    cdef const unsigned char[::1] borrowed
+    cdef DracoPy.BufferView view
+    held = []
+    for buffer in buffers:
+        borrowed = readable(buffer)
+        view.data = buffer_data(borrowed)
+        view.size = borrowed.shape[0]
+        views.push_back(view)
+        held.append(borrowed)
+    return held
+
+cdef cnp.ndarray copied_faces(DracoPy.MeshObject &mesh_struct):
+    cdef cnp.ndarray faces = np.empty((mesh_struct.num_faces, 3), dtype=np.uint32)
+    cdef void *out
+    if mesh_struct.num_faces > 0:
+        out = cnp.PyArray_DATA(faces)
+        with nogil:
+            DracoPy.copy_faces(mesh_struct, <uint32_t*>out)
+    return faces
+
+cdef object copied_attribute(DracoPy.MeshObject &mesh_struct, size_t i):
+    cdef cnp.ndarray data
+    cdef void *out
+    if mesh_struct.num_points == 0:
+        return None
+    dtype = NUMPY_DTYPES[DracoPy.decoded_data_type(mesh_struct.attributes[i].data_type)]
+    data = np.empty((mesh_struct.num_points, mesh_struct.attributes[i].num_components), dtype=dtype)
+    out = cnp.PyArray_DATA(data)
+    with nogil:
+        DracoPy.copy_attribute(mesh_struct, i, out)
+    return data
+
+cdef tuple copied_geometry(DracoPy.MeshObject &mesh_struct, bint faces, bint attributes, int threads):
+    """
+    Copies the faces and / or every attribute out of mesh_struct in one
+    pass on threads native threads, see copy_geometry. Returns the faces
+    (or None) and the list of attribute arrays (None when not copied).
     """
-    (DracoMesh|DracoPointCloud) decode(bytes buffer)
+    cdef cnp.ndarray faces_array = None
+    cdef cnp.ndarray data
+    cdef uint32_t *faces_out = NULL
+    cdef vector[void*] outs
+    cdef size_t i
+    arrays = [ None ] * mesh_struct.attributes.size()
+    if faces:
+        faces_array = np.empty((mesh_struct.num_faces, 3), dtype=np.uint32)
+        faces_out = <uint32_t*>cnp.PyArray_DATA(faces_array)
+    if attributes and mesh_struct.num_points > 0:
+        for i in range(mesh_struct.attributes.size()):
+            dtype = NUMPY_DTYPES[DracoPy.decoded_data_type(mesh_struct.attributes[i].data_type)]
+            data = np.empty((mesh_struct.num_points, mesh_struct.attributes[i].num_components), dtype=dtype)
+            arrays[i] = data
+            outs.push_back(cnp.PyArray_DATA(data))
+    with nogil:
+        DracoPy.copy_geometry(mesh_struct, faces_out, outs, threads)
+    return faces_array, arrays
+
+cdef class DecodedGeometry:
+    """
+    Owns a decoded draco geometry and copies its faces and attribute
+    values into NumPy arrays on request, each once; later requests get
+    the same array. Copies run without the GIL but one at a time per
+    geometry, so threads reading the same object wait for each other.
+    The geometry is freed once everything in it has been copied out, or
+    with this object.
+    """
+    cdef DracoPy.MeshObject mesh_struct
+    cdef dict arrays
+    cdef size_t num_arrays
+    cdef object lock
+
+    @staticmethod
+    cdef DecodedGeometry wrap(DracoPy.MeshObject &mesh_struct):
+        cdef DecodedGeometry geometry = DecodedGeometry.__new__(DecodedGeometry)
+        geometry.mesh_struct = mesh_struct
+        geometry.arrays = {}
+        geometry.num_arrays = mesh_struct.attributes.size() + (1 if mesh_struct.is_mesh else 0)
+        geometry.lock = threading.Lock()
+        return geometry
+
+    def __dealloc__(self):
+        DracoPy.release_geometry(self.mesh_struct)
+
+    cdef copied(self, key):
+        with self.lock:
+            if key not in self.arrays:
+                if key == 'faces':
+                    self.arrays[key] = copied_faces(self.mesh_struct)
+                else:
+                    self.arrays[key] = copied_attribute(self.mesh_struct, key)
+                # No other copy can be running while the lock is held.
+                if len(self.arrays) == self.num_arrays:
+                    DracoPy.release_geometry(self.mesh_struct)
+            return self.arrays[key]
 
-    Decodes a binary draco file into either a DracoPointCloud
-    or a DracoMesh.
+    def faces(self) -> np.ndarray:
+        return self.copied('faces')
+
+    def attribute(self, size_t index):
+        return self.copied(index)
+
+class DracoAttribute(dict):
+    """
+    The description of a decoded attribute (see DracoPointCloud.attributes)
+    whose 'data' array is copied out of the decoded geometry on first
+    access and then cached.
+    """
+    def __init__(self, description, geometry, index):
+        super().__init__(description)
+        self._geometry = geometry
+        self._index = index
+
+    def _materialize(self):
+        if self._geometry is not None:
+            dict.__setitem__(self, 'data', self._geometry.attribute(self._index))
+            self._geometry = None
+
+    def __getitem__(self, key):
+        if key == 'data':
+            self._materialize()
+        return dict.__getitem__(self, key)
+
+    def get(self, key, default=None):
+        return self[key] if key in self else default
+
+    # Overriding __iter__ also makes dict(attr) and {**attr} go through
+    # keys() and __getitem__ instead of reading the raw dict storage.
+    def __iter__(self):
+        return iter(dict.keys(self))
+
+    def items(self):
+        self._materialize()
+        return dict.items(self)
+
+    def values(self):
+        self._materialize()
+        return dict.values(self)
+
+    def copy(self):
+        return dict(self)
+
+    def __eq__(self, other):
+        self._materialize()
+        return dict.__eq__(self, other)
+
+    __hash__ = None
+
+    def __repr__(self):
+        self._materialize()
+        return dict.__repr__(self)
+
+    def __reduce__(self):
+        return (dict, (dict(self),))
+
+cdef dict decoded_struct(DracoPy.MeshObject &mesh_struct, dict stats=None, int threads=1):
+    """
+    Builds the dict consumed by DracoPointCloud. With a single thread and
+    no stats, faces and attribute values stay in the decoded geometry and
+    are copied out on first access (see DecodedGeometry). Otherwise
+    everything is copied up front, on threads threads, and with stats the
+    seconds spent copying faces and attributes and the number of bytes
+    copied are stored in it. Either way the C++ side writes straight into
+    the NumPy buffers.
+    """
+    cdef size_t i
+    cdef DecodedGeometry geometry
+
+    struct_info = {
+        'encoding_options_set': mesh_struct.encoding_options_set,
+        'quantization_bits': mesh_struct.quantization_bits,
+        'quantization_range': mesh_struct.quantization_range,
+        'quantization_origin': mesh_struct.quantization_origin,
+        'point_order': mesh_struct.point_order,
+        'permutation_unique_id': mesh_struct.permutation_unique_id,
+    }
+    if stats is None and threads == 1:
+        geometry = DecodedGeometry.wrap(mesh_struct)
+        attributes = []
+        for i in range(mesh_struct.attributes.size()):
+            attributes.append(DracoAttribute(attribute_description(mesh_struct.attributes[i], None), geometry, i))
+        return { 'attributes': attributes, 'faces': None, 'geometry': geometry, **struct_info }
+
+    if stats is None:
+        faces, arrays = copied_geometry(mesh_struct, True, True, threads)
+        attributes = [
+            attribute_description(mesh_struct.attributes[i], arrays[i])
+            for i in range(mesh_struct.attributes.size())
+        ]
+        return { 'attributes': attributes, 'faces': faces, **struct_info }
+
+    start = time.perf_counter()
+    faces, _ = copied_geometry(mesh_struct, True, False, threads)
+    stats['faces'] = time.perf_counter() - start
+    stats['uncompressed_bytes'] = faces.nbytes
+
+    start = time.perf_counter()
+    _, arrays = copied_geometry(mesh_struct, False, True, threads)
+    attributes = []
+    for i in range(mesh_struct.attributes.size()):
+        attributes.append(attribute_description(mesh_struct.attributes[i], arrays[i]))
+        if arrays[i] is not None:
+            stats['uncompressed_bytes'] += arrays[i].nbytes
+    stats['attributes'] = time.perf_counter() - start
+
+    return { 'attributes': attributes, 'faces': faces, **struct_info }
+
+cdef dict attribute_description(DracoPy.AttributeData &attribute, data):
+    name = attribute.name
+    encoding_options = {}
+    if attribute.quantization_bits >= 0:
+        encoding_options['quantization_bits'] = attribute.quantization_bits
+    if attribute.quantization_range > 0:
+        encoding_options['quantization_range'] = attribute.quantization_range
+        encoding_options['quantization_origin'] = list(attribute.quantization_origin)
+    if attribute.prediction_scheme != PredictionScheme.UNDEFINED:
+        encoding_options['prediction_scheme'] = PredictionScheme(attribute.prediction_scheme)
+    return {
+        'unique_id': attribute.unique_id,
+        'num_components': attribute.num_components,
+        'data_type': attribute.data_type,
+        'attribute_type': attribute.attribute_type,
+        'data': data,
+        'name': name.decode('utf-8') if name else None,
+        'encoding_options': encoding_options or None,
+    }
+
+cdef object decoded_object(DracoPy.MeshObject &mesh_struct, size_t compressed_bytes, bint collect=False, dict stats=None, int threads=1):
+    """
+    Wraps a decoded MeshObject in a DracoMesh or DracoPointCloud, copying
+    its data out on threads threads (see decoded_struct). When collect is
+    set (mesh_struct was decoded with collect_stats), its stats are
+    recorded along with the seconds spent copying and wrapping its data.
     """
-    mesh_struct = DracoPy.decode_buffer(buffer, len(buffer))
     if mesh_struct.decode_status != DracoPy.decoding_status.successful:
-        raise_decoding_error(mesh_struct.decode_status)
+        raise_decoding_error(mesh_struct.decode_status, mesh_struct.error_message)
+
+    if not collect:
+        data_struct = decoded_struct(mesh_struct, None, threads)
+        if mesh_struct.is_mesh:
+            return DracoMesh(data_struct)
+        return DracoPointCloud(data_struct)
+
+    call_stats = {
+        'header': mesh_struct.stats.header,
+        'draco': mesh_struct.stats.draco,
+        'describe': mesh_struct.stats.describe,
+    }
+    data_struct = decoded_struct(mesh_struct, call_stats, threads)
+    start = time.perf_counter()
+    obj = DracoMesh(data_struct) if mesh_struct.is_mesh else DracoPointCloud(data_struct)
+    call_stats['wrap'] = time.perf_counter() - start
+    call_stats['compressed_bytes'] = compressed_bytes
+    call_stats['native_bytes'] = mesh_struct.stats.native_bytes
+    call_stats['allocated_bytes'] = mesh_struct.stats.native_bytes + call_stats['uncompressed_bytes']
+    record('decode', call_stats, stats)
+    return obj
+
+cdef DracoPy.AttributeFilter attribute_filter(attributes) except *:
+    """
+    Translates the attributes argument of decode(): None keeps every
+    attribute, otherwise each item is an AttributeType, an integer
+    unique_id or a metadata name.
+    """
+    cdef DracoPy.AttributeFilter selection
+    selection.all = attributes is None
+    if attributes is None:
+        return selection
+
+    if isinstance(attributes, (str, int)):
+        attributes = [ attributes ]
+    for attribute in attributes:
+        if isinstance(attribute, AttributeType):
+            selection.types.push_back(attribute)
+        elif isinstance(attribute, int):
+            selection.unique_ids.push_back(attribute)
+        elif isinstance(attribute, str):
+            selection.names.push_back(attribute.encode('utf-8'))
+        else:
+            raise ValueError(f"Attributes are selected by AttributeType, unique_id or name, got {attribute!r}")
+    return selection
+
+cdef vector[double] crop_box(bbox) except *:
+    """
+    Translates the bbox argument of decode(): None, or the min and max
+    corners as six numbers or a (2, 3) array.
+    """
+    cdef vector[double] box
+    if bbox is None:
+        return box
+    values = np.asarray(bbox, dtype=np.float64).ravel()
+    if values.size != 6 or np.any(values[:3] > values[3:]):
+        raise ValueError(f"Bbox must be the min and max corners (x0, y0, z0, x1, y1, z1), got {bbox!r}")
+    box = values
+    return box
+
+DECODE_LIMITS = ('max_points', 'max_faces', 'max_attributes', 'max_output_bytes')
+
+cdef DracoPy.DecodeLimits decode_limits(limits) except *:
+    """
+    Translates the limits argument of decode(): None, or a dict with any
+    of DECODE_LIMITS mapped to a positive int or None (unbounded).
+    """
+    cdef DracoPy.DecodeLimits native
+    if limits is None:
+        return native
+    unknown = set(limits) - set(DECODE_LIMITS)
+    if unknown:
+        raise ValueError(f"Unknown decode limits {sorted(unknown)}, expected some of {list(DECODE_LIMITS)}")
+    values = {}
+    for key in DECODE_LIMITS:
+        value = limits.get(key)
+        if value is None:
+            value = 0
+        elif int(value) <= 0:
+            raise ValueError(f"Decode limit {key} must be positive or None, got {value!r}")
+        values[key] = int(value)
+    native.max_points = values['max_points']
+    native.max_faces = values['max_faces']
+    native.max_attributes = values['max_attributes']
+    native.max_output_bytes = values['max_output_bytes']
+    return native
+
+cdef DracoPy.DecodeOptions decode_options(attributes, quantized_positions, stats=None, bbox=None, limits=None) except *:
+    cdef DracoPy.DecodeOptions options
+    options.attributes = attribute_filter(attributes)
+    options.quantized_positions = quantized_positions
+    options.collect_stats = collecting(stats)
+    options.bbox = crop_box(bbox)
+    options.limits = decode_limits(limits)
+    return options
+
+def decode(buffer, attributes=None, quantized_positions=False, stats=None, bbox=None, int threads=1, limits=None) -> Union[DracoMesh, DracoPointCloud]:
+    """
+    (DracoMesh|DracoPointCloud) decode(
+        buffer, attributes=None, quantized_positions=False, stats=None,
+        bbox=None, threads=1, limits=None
+    )
+
+    Decodes a binary draco file into either a DracoPointCloud
+    or a DracoMesh. The GIL is released while Draco decodes.
+
+    Buffer is any C-contiguous bytes-like object: bytes, bytearray,
+    memoryview, mmap or a NumPy array. Draco reads it in place, so a
+    slice of a larger mapped file is decoded without being copied.
 
-    if len(mesh_struct.faces) > 0:
-        return DracoMesh(mesh_struct)
-    return DracoPointCloud(mesh_struct)
+    Attributes optionally restricts the attributes that are extracted.
+    Each item is an AttributeType (e.g. AttributeType.POSITION), an
+    integer unique_id or a metadata name; an attribute matching any item
+    is kept. Dropped attributes are never copied out, and Draco skips
+    the dequantization of attribute types nothing can select (only
+    possible when selecting by type alone). Faces are always decoded.
+
+        @example
+        ```python
+        # positions and faces only
+        mesh = DracoPy.decode(buffer, attributes=[AttributeType.POSITION])
+        ```
+
+    Quantized_positions skips the dequantization of positions: points are
+    returned as int32 indices on the quantization grid, and
+    encoding_options holds the grid (origin, range and bits) read from the
+    bitstream itself, so no metadata is needed. Use
+    encoding_options.dequantize_points() to recover the float positions.
+    Positions that were not quantized are returned as usual.
+
+    Bbox crops the result to the points whose position lies inside the
+    box (x0, y0, z0, x1, y1, z1), bounds included, and to the faces whose
+    three vertices do; faces are renumbered over the kept points. The
+    box is in the units of the returned positions, i.e. grid indices with
+    quantized_positions. Draco still decodes everything, but only the
+    kept points and faces are copied out, so memory and copy time follow
+    the size of the crop.
+
+        @example
+        ```python
+        # what the camera sees
+        part = DracoPy.decode(buffer, bbox=[ -1, -1, 0, 1, 1, 5 ])
+        ```
+
+    Threads sets how many native threads copy the decoded faces and
+    attributes into NumPy, without the GIL; 0 uses one per core. With
+    one thread (the default) each array is copied on first access. With
+    more, everything is copied right after decoding: the faces and every
+    attribute, cut into ranges of rows so that a single large attribute
+    is shared between threads too. Draco's own decode is single threaded.
+
+    Limits bounds what untrusted input may make Draco allocate: a dict
+    with any of max_points, max_faces, max_attributes and
+    max_output_bytes (faces and attribute values as Draco decodes them,
+    before any crop). The header holds no counts, so each limit is
+    checked as soon as Draco has read what it bounds. For meshes this
+    library writes, the point and face counts (and the faces' bytes)
+    are checked before connectivity is decoded; in older bitstreams
+    they are checked right after it. The attribute count and total
+    output are checked before any attribute values are decoded. So a
+    small file claiming billions of points fails fast with
+    DecodeLimitException. Input that is not Draco raises
+    FileTypeException, and input Draco fails on raises TypeError with
+    Draco's reason.
+
+        @example
+        ```python
+        mesh = DracoPy.decode(upload, limits={ 'max_points': 10_000_000, 'max_output_bytes': 1 << 30 })
+        ```
+
+    Stats, when a dict, is filled with the seconds spent in each stage:
+    header (geometry type sniff), draco (Draco's decoder), describe
+    (attribute descriptions and metadata), faces and attributes (copies
+    into NumPy) and wrap (building the returned object); and with the
+    compressed_bytes of the input, the uncompressed_bytes of the returned
+    arrays, the native_bytes of the draco geometry and the allocated_bytes
+    of the whole call. See also enable_counters().
+    """
+    cdef const unsigned char[::1] view = readable(buffer)
+    cdef const char *data = buffer_data(view)
+    cdef size_t size = view.shape[0]
+    cdef DracoPy.DecodeOptions options = decode_options(attributes, quantized_positions, stats, bbox, limits)
+    cdef DracoPy.MeshObject mesh_struct
+    with nogil:
+        mesh_struct = DracoPy.decode_buffer(data, size, options)
+    return decoded_object(mesh_struct, size, options.collect_stats, stats, threads)
+
+def decode_file(path, attributes=None, quantized_positions=False, stats=None, bbox=None, int threads=1, limits=None) -> Union[DracoMesh, DracoPointCloud]:
+    """
+    (DracoMesh|DracoPointCloud) decode_file(
+        path, attributes=None, quantized_positions=False, stats=None,
+        bbox=None, threads=1, limits=None
+    )
+
+    Decodes the draco file at path by memory-mapping it, so its contents
+    are paged in by Draco as it reads them instead of being read() into
+    an intermediate bytes object. Other arguments are those of decode().
+    """
+    with open(path, 'rb') as f:
+        if os.fstat(f.fileno()).st_size == 0:
+            return decode(b'', attributes, quantized_positions, stats, bbox, threads, limits)
+        with mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as mapped:
+            return decode(mapped, attributes, quantized_positions, stats, bbox, threads, limits)
+
+def probe(buffer) -> dict:
+    """
+    dict probe(buffer)
+
+    Describes a binary draco file without decoding its attribute values
+    or copying any geometry out. Returns a dict with:
+        geometry_type: EncodedGeometryType of the buffer
+        encoding_method: Draco encoding method (0 sequential, 1 edgebreaker
+            for meshes or kd-tree for point clouds)
+        num_points, num_faces: vertex and face counts
+        attributes: the attribute dicts decode() would return, with
+            'data' set to None
+        encoding_options: EncodingOptions from the metadata, or None
+
+    Connectivity still has to be decoded to count points, so probing a
+    mesh costs a fraction of decode(), not nothing. Buffer is any
+    bytes-like object, see decode().
+    """
+    cdef const unsigned char[::1] view = readable(buffer)
+    cdef const char *data = buffer_data(view)
+    cdef size_t size = view.shape[0]
+    cdef DracoPy.ProbeObject probe_struct
+    with nogil:
+        probe_struct = DracoPy.probe_buffer(data, size)
+    if probe_struct.decode_status != DracoPy.decoding_status.successful:
+        raise_decoding_error(probe_struct.decode_status, probe_struct.error_message)
+
+    cdef size_t i
+    attributes = []
+    for i in range(probe_struct.attributes.size()):
+        attributes.append(attribute_description(probe_struct.attributes[i], None))
+
+    encoding_options = None
+    if probe_struct.encoding_options_set:
+        encoding_options = EncodingOptions(probe_struct.quantization_bits,
+            probe_struct.quantization_range, probe_struct.quantization_origin)
+    return {
+        'geometry_type': EncodedGeometryType(probe_struct.geometry_type),
+        'encoding_method': probe_struct.encoding_method,
+        'num_points': probe_struct.num_points,
+        'num_faces': probe_struct.num_faces,
+        'attributes': attributes,
+        'encoding_options': encoding_options,
+    }
+
+def decode_many(buffers, int threads=0, attributes=None, quantized_positions=False, bbox=None, limits=None) -> list:
+    """
+    list[DracoMesh|DracoPointCloud] decode_many(
+        buffers, threads=0, attributes=None, quantized_positions=False,
+        bbox=None, limits=None
+    )
+
+    Decodes a sequence of binary draco files on a native thread pool
+    without holding the GIL. Threads is the pool size; 0 uses one
+    thread per core. Attributes, quantized_positions, bbox and limits
+    apply to every file, see decode(). Buffers may be any bytes-like objects, e.g.
+    slices of one memory-mapped file. Results are returned in the same
+    order as buffers.
+    """
+    cdef DracoPy.DecodeOptions options = decode_options(attributes, quantized_positions, bbox=bbox, limits=limits)
+    cdef vector[DracoPy.BufferView] views
+    held = buffer_views(buffers, views)
+
+    cdef vector[DracoPy.MeshObject] mesh_structs
+    with nogil:
+        mesh_structs = DracoPy.decode_buffers(views, options, threads)
+
+    cdef size_t i
+    results = []
+    for i in range(mesh_structs.size()):
+        results.append(decoded_object(mesh_structs[i], views[i].size, options.collect_stats))
+    return results
+
+cdef class Decoder:
+    """
+    Decoder(attributes=None, quantized_positions=False, threads=1, limits=None)
+
+    Decodes many buffers with the same options, which have the meaning
+    described in decode(). The options are translated and the Draco
+    decoder configured once, instead of on every call.
+
+    A Decoder may be shared between threads: each call decodes with its
+    own bbox and stats, but calls take turns on the Draco decoder; give
+    each thread its own Decoder to decode in parallel.
+
+        @example
+        ```python
+        decoder = DracoPy.Decoder(attributes=[DracoPy.AttributeType.POSITION])
+        meshes = [ decoder.decode(binary) for binary in binaries ]
+        ```
+    """
+    cdef DracoPy.DecoderContext *context
+    cdef int threads
+    cdef object lock
+
+    def __cinit__(self, attributes=None, quantized_positions=False, int threads=1, limits=None):
+        self.context = new DracoPy.DecoderContext(decode_options(attributes, quantized_positions, limits=limits))
+        self.threads = threads
+        self.lock = threading.Lock()
+
+    def __dealloc__(self):
+        del self.context
+
+    def decode(self, buffer, stats=None, bbox=None) -> Union[DracoMesh, DracoPointCloud]:
+        """
+        Same as DracoPy.decode() with this decoder's options. Bbox is
+        given per call, e.g. to follow a camera.
+        """
+        cdef const unsigned char[::1] view = readable(buffer)
+        cdef const char *data = buffer_data(view)
+        cdef size_t size = view.shape[0]
+        cdef DracoPy.DecoderContext *context = self.context
+        cdef DracoPy.MeshObject mesh_struct
+        cdef bint collect = collecting(stats)
+        cdef vector[double] box = crop_box(bbox)
+        # The context's options are per call until its decode returns.
+        with self.lock:
+            context.set_collect_stats(collect)
+            context.set_bbox(box)
+            with nogil:
+                mesh_struct = context.decode(data, size)
+        return decoded_object(mesh_struct, size, collect, stats, self.threads)
+
+    def decode_many(self, buffers, int threads=0, bbox=None) -> list:
+        """Same as DracoPy.decode_many() with this decoder's options."""
+        cdef vector[DracoPy.BufferView] views
+        held = buffer_views(buffers, views)
+
+        cdef DracoPy.DecoderContext *context = self.context
+        cdef vector[DracoPy.MeshObject] mesh_structs
+        cdef bint collect = collecting(None)
+        cdef vector[double] box = crop_box(bbox)
+        with self.lock:
+            context.set_collect_stats(collect)
+            context.set_bbox(box)
+            with nogil:
+                mesh_structs = DracoPy.decode_buffers(views, context.options(), threads)
+
+        cdef size_t i
+        results = []
+        for i in range(mesh_structs.size()):
+            results.append(decoded_object(mesh_structs[i], views[i].size, collect))
+        return results
+
+# SHARDED CONTAINER
+#
+# Layout (little endian):
+#   header   magic b'DRCSHARD', uint32 version, uint32 flags,
+#            uint64 num_fragments, uint64 index_offset
+#   data     the encoded fragments, back to back
+#   index    uint64 ids[n] (sorted), uint64 offsets[n], uint64 lengths[n],
+#            and with SHARD_HAS_BBOXES float32 bboxes[n, 6] (min xyz, max xyz)
+
+SHARD_MAGIC = b'DRCSHARD'
+SHARD_VERSION = 1
+SHARD_HAS_BBOXES = 1
+_shard_header = struct.Struct('<8sIIQQ')
+
+class ShardWriter:
+    """
+    ShardWriter(path, bboxes=False)
+
+    Packs encoded fragments into one file that ShardReader can decode
+    any fragment of without reading the others. Fragments are streamed
+    to disk as they are added; the index is written by close(), or on
+    leaving a with block.
+
+    With bboxes=True every fragment carries a bounding box, either given
+    to add() or, for add_mesh(), computed from its points.
+
+        @example
+        ```python
+        with DracoPy.ShardWriter('object.shard', bboxes=True) as shard:
+            for fragment_id, (points, faces) in enumerate(fragments):
+                shard.add_mesh(fragment_id, points, faces, quantization_bits=11)
+        ```
+    """
+    def __init__(self, path, bboxes=False):
+        self.bboxes = bboxes
+        self._file = open(path, 'wb')
+        self._file.write(b'\0' * _shard_header.size)
+        self._offset = _shard_header.size
+        self._ids = []
+        self._id_set = set()
+        self._offsets = []
+        self._lengths = []
+        self._bboxes = []
+
+    def add(self, fragment_id, buffer, bbox=None):
+        """
+        Appends an encoded fragment under the non-negative integer
+        fragment_id. Bbox is (min_x, min_y, min_z, max_x, max_y, max_z)
+        and is required when the writer stores bounding boxes.
+        """
+        if fragment_id < 0:
+            raise ValueError(f"Fragment ids must be non-negative, got {fragment_id}")
+        if fragment_id in self._id_set:
+            raise ValueError(f"Fragment ids must be unique, {fragment_id} was already added")
+        if self.bboxes:
+            if bbox is None:
+                raise ValueError("This shard stores bounding boxes, bbox is required")
+            self._bboxes.append(np.asarray(bbox, dtype=np.float32).reshape(6))
+
+        self._file.write(buffer)
+        length = memoryview(buffer).nbytes
+        self._ids.append(fragment_id)
+        self._id_set.add(fragment_id)
+        self._offsets.append(self._offset)
+        self._lengths.append(length)
+        self._offset += length
+
+    def add_mesh(self, fragment_id, points, faces=None, **kwargs):
+        """
+        Encodes a mesh or point cloud with encode(points, faces, **kwargs)
+        and appends it, with the bounding box of its points.
+        """
+        points = np.asarray(points).reshape((-1, 3))
+        bbox = None
+        if self.bboxes:
+            bbox = np.concatenate([ points.min(axis=0), points.max(axis=0) ]) if len(points) else np.zeros(6)
+        self.add(fragment_id, encode(points, faces, **kwargs), bbox)
+
+    def close(self):
+        if self._file is None:
+            return
+        ids = np.asarray(self._ids, dtype='<u8')
+        order = np.argsort(ids, kind='stable')
+        ids = ids[order]
+        self._file.write(ids.tobytes())
+        self._file.write(np.asarray(self._offsets, dtype='<u8')[order].tobytes())
+        self._file.write(np.asarray(self._lengths, dtype='<u8')[order].tobytes())
+        flags = 0
+        if self.bboxes:
+            flags |= SHARD_HAS_BBOXES
+            self._file.write(np.asarray(self._bboxes, dtype='<f4').reshape((-1, 6))[order].tobytes())
+
+        self._file.seek(0)
+        self._file.write(_shard_header.pack(SHARD_MAGIC, SHARD_VERSION, flags, len(ids), self._offset))
+        self._file.close()
+        self._file = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc, tb):
+        self.close()
+
+class ShardReader:
+    """
+    ShardReader(path)
+
+    Reads a file written by ShardWriter. Opening it maps the file and
+    reads only the header: the index arrays are views of the mapping,
+    so their pages are loaded on first lookup, and fragments are handed
+    to Draco straight from the mapped region without being copied.
+
+        @example
+        ```python
+        with DracoPy.ShardReader('object.shard') as shard:
+            mesh = shard.decode(42)
+            meshes = shard.decode_many(shard.intersecting([0, 0, 0], [10, 10, 10]))
+        ```
+
+    Memoryviews returned by fragment() must be released before close().
+    """
+    def __init__(self, path):
+        self._file = open(path, 'rb')
+        try:
+            self._map = mmap.mmap(self._file.fileno(), 0, access=mmap.ACCESS_READ)
+        except ValueError:
+            self._file.close()
+            raise FileTypeException(f'{path} is not a DracoPy shard')
+        self._view = memoryview(self._map)
+        try:
+            self._read_index(path)
+        except Exception:
+            self.close()
+            raise
+
+    def _read_index(self, path):
+        if len(self._view) < _shard_header.size:
+            raise FileTypeException(f'{path} is not a DracoPy shard')
+        magic, version, flags, num_fragments, index_offset = _shard_header.unpack_from(self._view)
+        if magic != SHARD_MAGIC:
+            raise FileTypeException(f'{path} is not a DracoPy shard')
+        if version != SHARD_VERSION:
+            raise FileTypeException(f'{path} has unsupported shard version {version}')
+
+        n = num_fragments
+        index_size = n * 24 + (n * 24 if flags & SHARD_HAS_BBOXES else 0)
+        if index_offset + index_size > len(self._view):
+            raise FileTypeException(f'{path} has a truncated index')
+
+        self.ids = np.frombuffer(self._view, dtype='<u8', count=n, offset=index_offset)
+        self._offsets = np.frombuffer(self._view, dtype='<u8', count=n, offset=index_offset + n * 8)
+        self._lengths = np.frombuffer(self._view, dtype='<u8', count=n, offset=index_offset + n * 16)
+        self.bboxes = None
+        if flags & SHARD_HAS_BBOXES:
+            self.bboxes = np.frombuffer(self._view, dtype='<f4', count=n * 6, offset=index_offset + n * 24).reshape((n, 6))
+
+    def __len__(self):
+        return len(self.ids)
+
+    def __contains__(self, fragment_id):
+        return self._find(fragment_id) >= 0
+
+    def _find(self, fragment_id):
+        if fragment_id < 0:
+            return -1
+        fragment_id = np.uint64(fragment_id)
+        i = int(np.searchsorted(self.ids, fragment_id))
+        if i < len(self.ids) and self.ids[i] == fragment_id:
+            return i
+        return -1
+
+    def _index(self, fragment_id):
+        i = self._find(fragment_id)
+        if i < 0:
+            raise KeyError(fragment_id)
+        return i
+
+    def fragment(self, fragment_id) -> memoryview:
+        """Zero-copy view of the encoded bytes of a fragment."""
+        i = self._index(fragment_id)
+        offset = int(self._offsets[i])
+        return self._view[offset:offset + int(self._lengths[i])]
+
+    def bbox(self, fragment_id):
+        """Bounding box of a fragment as (min_x, min_y, min_z, max_x, max_y, max_z)."""
+        if self.bboxes is None:
+            raise ValueError("This shard has no bounding boxes")
+        # A copy, since a view of the mapping would keep close() from
+        # releasing it.
+        return self.bboxes[self._index(fragment_id)].copy()
+
+    def intersecting(self, bbox_min, bbox_max) -> np.ndarray:
+        """Ids of the fragments whose bounding box intersects [bbox_min, bbox_max]."""
+        if self.bboxes is None:
+            raise ValueError("This shard has no bounding boxes")
+        bbox_min = np.asarray(bbox_min, dtype=np.float32)
+        bbox_max = np.asarray(bbox_max, dtype=np.float32)
+        hits = np.all((self.bboxes[:,:3] <= bbox_max) & (self.bboxes[:,3:] >= bbox_min), axis=1)
+        return self.ids[hits]
+
+    def decode(self, fragment_id, **kwargs) -> Union[DracoMesh, DracoPointCloud]:
+        """Decodes one fragment; keyword arguments are those of decode()."""
+        fragment = self.fragment(fragment_id)
+        try:
+            return decode(fragment, **kwargs)
+        finally:
+            fragment.release()
+
+    def decode_many(self, fragment_ids, int threads=0, **kwargs) -> list:
+        """
+        Decodes a batch of fragments on a native thread pool, see
+        decode_many(). Results are in the order of fragment_ids.
+        """
+        fragments = [ self.fragment(fragment_id) for fragment_id in fragment_ids ]
+        try:
+            return decode_many(fragments, threads, **kwargs)
+        finally:
+            for fragment in fragments:
+                fragment.release()
+
+    def close(self):
+        if self._file is None:
+            return
+        self.ids = self._offsets = self._lengths = self.bboxes = None
+        self._view.release()
+        self._map.close()
+        self._file.close()
+        self._file = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc, tb):
+        self.close()
+
+def _benchmark_attribute_copies(bytes buffer, int repeats=10) -> list:
+    """
+    Decodes buffer once and then times copying each attribute out of the
+    decoded geometry into a NumPy array, repeats times. Returns a list of
+    (attribute_type, data_type, num_components, num_points, seconds per copy).
+    Used by benchmarks/decode_kernels.py; not part of the public API.
+    """
+    cdef const char *data = buffer
+    cdef size_t size = len(buffer)
+    cdef DracoPy.MeshObject mesh_struct
+    with nogil:
+        mesh_struct = DracoPy.decode_buffer(data, size)
+    if mesh_struct.decode_status != DracoPy.decoding_status.successful:
+        raise_decoding_error(mesh_struct.decode_status, mesh_struct.error_message)
+
+    cdef cnp.ndarray out_array
+    cdef void *out
+    cdef size_t i
+    cdef int r
+    results = []
+    for i in range(mesh_struct.attributes.size()):
+        dtype = NUMPY_DTYPES[DracoPy.decoded_data_type(mesh_struct.attributes[i].data_type)]
+        out_array = np.empty((mesh_struct.num_points, mesh_struct.attributes[i].num_components), dtype=dtype)
+        out = cnp.PyArray_DATA(out_array)
+        start = time.perf_counter()
+        with nogil:
+            for r in range(repeats):
+                DracoPy.copy_attribute(mesh_struct, i, out)
+        elapsed = (time.perf_counter() - start) / max(repeats, 1)
+        results.append((
+            AttributeType(mesh_struct.attributes[i].attribute_type),
+            DataType(mesh_struct.attributes[i].data_type),
+            mesh_struct.attributes[i].num_components,
+            mesh_struct.num_points,
+            elapsed,
+        ))
+    return results
 
 # FOR BACKWARDS COMPATIBILITY
 
@@ -163,6 +163,12 @@ def test_decoding_and_encoding_mesh_file_integer_positions():
     )
     assert encoding_test_uint == encoding_test_uint64
 
+    # 64 bit positions are narrowed to 32 bits, never wrapped
+    with pytest.raises(ValueError):
+        DracoPy.encode(points.astype(np.int64) - 2 ** 40, mesh_object.faces)
+    with pytest.raises(ValueError):
+        DracoPy.encode(points.astype(np.uint64) + 2 ** 40, mesh_object.faces)
+
     mesh_object = DracoPy.decode(encoding_test_uint)
 
     assert len(mesh_object.points) == EXPECTED_POINTS_BUNNY_MESH
@@ -372,6 +378,36 @@ def test_named_generic_attributes(object_type):
     assert np.allclose(decoded_weights["data"], test_weights)
 
 
+@pytest.mark.parametrize("dtype", [ np.int64, np.int32, np.float64 ])
+def test_faces_must_reference_points(dtype):
+    points = np.random.default_rng(0).random((100, 3), dtype=np.float32)
+    for bad in (-1, 100, 2 ** 32):
+        if bad == 2 ** 32 and dtype == np.int32:
+            continue
+        faces = np.array([[0, 1, 2], [3, 4, bad]], dtype=dtype)
+        with pytest.raises(ValueError):
+            DracoPy.encode(points, faces)
+        with pytest.raises(ValueError):
+            DracoPy.encode(points, faces, preserve_order=True)
+    DracoPy.encode(points, np.array([[0, 1, 99]], dtype=dtype))
+
+
+@pytest.mark.parametrize("faces", [ True, False ])
+def test_attribute_rows_must_match_points(faces):
+    points = np.random.default_rng(0).random((100, 3), dtype=np.float32)
+    faces = np.array([[0, 1, 2]], dtype=np.uint32) if faces else None
+    too_many = {
+        "colors": np.zeros((101, 3), dtype=np.uint8),
+        "tex_coord": np.zeros((101, 2), dtype=np.float32),
+        "normals": np.zeros((101, 3), dtype=np.float32),
+    }
+    for name, values in too_many.items():
+        with pytest.raises(ValueError):
+            DracoPy.encode(points, faces, **{ name: values })
+        with pytest.raises(ValueError):
+            DracoPy.encode(points, faces, **{ name: values[:99] })
+
+
 def test_invalid_generic_attribute_keys():
     # Read reference mesh
     with open(os.path.join(testdata_directory, "bunny.drc"), 'rb') as draco_file:
@@ -397,3 +433,777 @@ def test_invalid_generic_attribute_keys():
     }
     with pytest.raises(ValueError):
         DracoPy.encode(mesh.points, mesh.faces, generic_attributes=generic_attributes)
+
+
+def test_decode_returns_numpy_arrays():
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        mesh = DracoPy.decode(draco_file.read())
+
+    assert isinstance(mesh.faces, np.ndarray)
+    assert mesh.faces.dtype == np.uint32
+    assert mesh.faces.shape == (EXPECTED_FACES_BUNNY, 3)
+    assert mesh.faces.flags.c_contiguous
+
+    assert isinstance(mesh.points, np.ndarray)
+    assert mesh.points.dtype == np.float32
+    assert mesh.points.shape == (EXPECTED_POINTS_BUNNY_MESH, 3)
+    assert mesh.points.flags.c_contiguous
+
+
+def test_encode_decode_many():
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        mesh = DracoPy.decode(draco_file.read())
+
+    objects = [
+        (mesh.points, mesh.faces),
+        { "points": mesh.points },
+        { "points": mesh.points, "faces": mesh.faces, "compression_level": 7 },
+    ]
+    binaries = DracoPy.encode_many(objects, threads=3)
+    assert len(binaries) == 3
+    assert binaries[0] == DracoPy.encode(mesh.points, mesh.faces)
+    assert binaries[1] == DracoPy.encode(mesh.points)
+    assert binaries[2] == DracoPy.encode(mesh.points, mesh.faces, compression_level=7)
+
+    decoded = DracoPy.decode_many(binaries, threads=3)
+    assert type(decoded[0]) is DracoPy.DracoMesh
+    assert type(decoded[1]) is DracoPy.DracoPointCloud
+    assert type(decoded[2]) is DracoPy.DracoMesh
+    for obj in decoded:
+        assert len(obj.points) == EXPECTED_POINTS_BUNNY_MESH
+
+    with pytest.raises(DracoPy.FileTypeException):
+        DracoPy.decode_many([ binaries[0], b"not a draco file" ])
+
+
+def test_decode_quantized_positions():
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        mesh = DracoPy.decode(draco_file.read())
+    binary = DracoPy.encode(mesh.points, mesh.faces, quantization_bits=12)
+
+    full = DracoPy.decode(binary)
+    quantized = DracoPy.decode(binary, quantized_positions=True)
+    assert quantized.points.dtype == np.int32
+    assert np.array_equal(quantized.faces, full.faces)
+    assert quantized.points.min() >= 0
+    assert quantized.points.max() <= 2 ** 12 - 1
+
+    eo = quantized.encoding_options
+    assert eo.quantization_bits == 12
+    assert np.array_equal(eo.dequantize_points(quantized.points), full.points)
+    assert np.array_equal(eo.quantize_points(full.points), quantized.points)
+
+    points = full.points[:100]
+    expected = [ eo.get_encoded_point(point) for point in points ]
+    assert np.allclose(eo.get_encoded_points(points), expected, atol=1e-5)
+
+
+def test_decode_selected_attributes():
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        mesh = DracoPy.decode(draco_file.read())
+    num_points = len(mesh.points)
+    binary = DracoPy.encode(
+        mesh.points, mesh.faces,
+        normals=np.ones((num_points, 3), dtype=np.float32),
+        generic_attributes={
+            5: np.arange(num_points, dtype=np.uint32).reshape((-1, 1)),
+            "labels": np.arange(num_points, dtype=np.uint16).reshape((-1, 1)),
+        },
+    )
+    full = DracoPy.decode(binary)
+    assert len(full.attributes) == 4
+
+    positions = DracoPy.decode(binary, attributes=[DracoPy.AttributeType.POSITION])
+    assert len(positions.attributes) == 1
+    assert np.array_equal(positions.points, full.points)
+    assert np.array_equal(positions.faces, full.faces)
+    assert positions.normals is None
+
+    selected = DracoPy.decode(binary, attributes=[DracoPy.AttributeType.NORMAL, 5, "labels"])
+    assert selected.points is None
+    assert np.array_equal(selected.normals, full.normals)
+    assert np.array_equal(selected.get_attribute_by_unique_id(5)["data"], full.get_attribute_by_unique_id(5)["data"])
+    assert np.array_equal(selected.get_attribute_by_name("labels")["data"], full.get_attribute_by_name("labels")["data"])
+
+    assert len(DracoPy.decode(binary, attributes=[]).attributes) == 0
+    many = DracoPy.decode_many([ binary ] * 2, attributes=["labels"])
+    assert all(len(obj.attributes) == 1 for obj in many)
+
+
+@pytest.mark.parametrize("preserve_order", [False, True])
+def test_probe(preserve_order):
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        mesh = DracoPy.decode(draco_file.read())
+
+    binary = DracoPy.encode(
+        mesh.points, mesh.faces, preserve_order=preserve_order,
+        quantization_range=1000, quantization_origin=[-100, -100, -100],
+        create_metadata=True, generic_attributes={ "labels": np.arange(len(mesh.points), dtype=np.uint16).reshape((-1, 1)) },
+    )
+    decoded = DracoPy.decode(binary)
+    info = DracoPy.probe(binary)
+    assert info["geometry_type"] == DracoPy.EncodedGeometryType.TRIANGULAR_MESH
+    assert info["encoding_method"] == (0 if preserve_order else 1)
+    assert info["num_points"] == len(decoded.points)
+    assert info["num_faces"] == len(decoded.faces)
+    assert info["encoding_options"].quantization_range == 1000
+    assert [ { **attr, "data": None } for attr in decoded.attributes ] == info["attributes"]
+
+    info = DracoPy.probe(DracoPy.encode(mesh.points))
+    assert info["geometry_type"] == DracoPy.EncodedGeometryType.POINT_CLOUD
+    assert info["num_faces"] == 0
+    assert info["encoding_options"] is None
+
+    with pytest.raises(DracoPy.FileTypeException):
+        DracoPy.probe(b"not a draco file")
+
+
+def test_encode_lods():
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        mesh = DracoPy.decode(draco_file.read())
+
+    binaries = DracoPy.encode_lods(
+        mesh.points, mesh.faces, levels=[1.0, 0.25, 0.5],
+        threads=3, create_metadata=True,
+    )
+    assert len(binaries) == 3
+    lods = DracoPy.decode_many(binaries)
+    full, quarter, half = lods
+    assert len(full.faces) == len(mesh.faces)
+    assert len(quarter.faces) <= np.ceil(0.25 * len(mesh.faces))
+    assert len(quarter.faces) < len(half.faces) < len(full.faces)
+
+    for lod in lods:
+        assert np.allclose(lod.encoding_options.quantization_origin, full.encoding_options.quantization_origin)
+        assert lod.encoding_options.quantization_range == full.encoding_options.quantization_range
+
+    # Coarser levels only keep vertices of the full mesh, on the same grid.
+    full_points = { tuple(p) for p in full.points }
+    assert all(tuple(p) in full_points for p in half.points)
+    assert all(tuple(p) in full_points for p in quarter.points)
+
+    with pytest.raises(ValueError):
+        DracoPy.encode_lods(mesh.points, mesh.faces, levels=[0])
+
+
+def test_encode_lods_stay_manifold():
+    # a bumpy 200 x 200 grid: manifold, with a boundary
+    n = 200
+    rng = np.random.default_rng(0)
+    x, y = np.meshgrid(np.arange(n, dtype=np.float32), np.arange(n, dtype=np.float32))
+    points = np.stack([ x.ravel(), y.ravel(), rng.random(n * n, dtype=np.float32) ], axis=1)
+    corner = (np.arange(n - 1)[None, :] + n * np.arange(n - 1)[:, None]).ravel()
+    faces = np.concatenate([
+        np.stack([ corner, corner + 1, corner + n ], axis=1),
+        np.stack([ corner + 1, corner + n + 1, corner + n ], axis=1),
+    ]).astype(np.uint32)
+
+    levels = [ 0.5, 0.1, 0.02 ]
+    binaries = DracoPy.encode_lods(points, faces, levels=levels, preserve_order=True)
+    for level, binary in zip(levels, binaries):
+        lod = DracoPy.decode(binary).faces
+        assert len(lod) <= np.ceil(level * len(faces))
+        assert len(np.unique(np.sort(lod, axis=1), axis=0)) == len(lod)
+        edges = np.sort(np.concatenate([ lod[:, [0, 1]], lod[:, [1, 2]], lod[:, [2, 0]] ]), axis=1)
+        _, counts = np.unique(edges, axis=0, return_counts=True)
+        assert counts.max() <= 2
+
+
+def test_encoder_decoder_objects():
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        mesh = DracoPy.decode(draco_file.read())
+
+    encoder = DracoPy.Encoder(quantization_bits=12, compression_level=5)
+    decoder = DracoPy.Decoder(attributes=[DracoPy.AttributeType.POSITION])
+    for points in (mesh.points, mesh.points[:1000], mesh.points):
+        expected = DracoPy.encode(points, quantization_bits=12, compression_level=5)
+        binary = encoder.encode(points)
+        assert binary == expected
+        assert np.array_equal(decoder.decode(binary).points, DracoPy.decode(expected).points)
+
+    binary = encoder.encode(mesh.points, mesh.faces)
+    assert binary == DracoPy.encode(mesh.points, mesh.faces, quantization_bits=12, compression_level=5)
+    decoded = decoder.decode_many([ binary, binary ], threads=2)
+    assert all(np.array_equal(obj.faces, decoded[0].faces) for obj in decoded)
+
+
+def test_encoder_decoder_objects_from_threads():
+    from concurrent.futures import ThreadPoolExecutor
+
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        binary = draco_file.read()
+    mesh = DracoPy.decode(binary)
+    sizes = [ 100, 1000, 10000, len(mesh.points) ]
+    expected = [ DracoPy.encode(mesh.points[:n]) for n in sizes ]
+
+    encoder = DracoPy.Encoder()
+    with ThreadPoolExecutor(8) as pool:
+        for _ in range(5):
+            assert list(pool.map(lambda n: encoder.encode(mesh.points[:n]), sizes)) == expected
+
+    decoder = DracoPy.Decoder()
+    lo, hi = mesh.points.min(axis=0), mesh.points.max(axis=0)
+    boxes = [ None ] + [ np.concatenate([ lo, lo + (hi - lo) * f ]) for f in (0.25, 0.5, 0.75) ]
+    crops = [ len(DracoPy.decode(binary, bbox=box).points) for box in boxes ]
+    with ThreadPoolExecutor(8) as pool:
+        for _ in range(5):
+            assert [ len(m.points) for m in pool.map(lambda box: decoder.decode(binary, bbox=box), boxes) ] == crops
+
+
+def test_decode_buffer_protocol(tmp_path):
+    path = os.path.join(testdata_directory, "bunny.drc")
+    with open(path, "rb") as draco_file:
+        binary = draco_file.read()
+    expected = DracoPy.decode(binary)
+
+    shard = b"\0" * 7 + binary + b"\0" * 5
+    for buffer in (
+        bytearray(binary),
+        memoryview(shard)[7:7 + len(binary)],
+        np.frombuffer(binary, dtype=np.uint8),
+    ):
+        mesh = DracoPy.decode(buffer)
+        assert np.array_equal(mesh.points, expected.points)
+        assert np.array_equal(mesh.faces, expected.faces)
+
+    assert DracoPy.probe(bytearray(binary))["num_points"] == len(expected.points)
+    meshes = DracoPy.decode_many([ memoryview(shard)[7:7 + len(binary)], bytearray(binary) ], threads=2)
+    assert all(np.array_equal(mesh.faces, expected.faces) for mesh in meshes)
+
+    mesh = DracoPy.decode_file(path)
+    assert np.array_equal(mesh.points, expected.points)
+
+    empty = tmp_path / "empty.drc"
+    empty.write_bytes(b"")
+    with pytest.raises(Exception):
+        DracoPy.decode_file(str(empty))
+    with pytest.raises(TypeError):
+        DracoPy.decode("not a buffer")
+
+
+def test_shard_container(tmp_path):
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        mesh = DracoPy.decode(draco_file.read())
+    points, faces = mesh.points, mesh.faces
+
+    path = str(tmp_path / "object.shard")
+    halves = [ points[:len(points) // 2], points[len(points) // 2:] ]
+    with DracoPy.ShardWriter(path, bboxes=True) as shard:
+        shard.add_mesh(7, points, faces)
+        shard.add_mesh(3, halves[0])
+        shard.add_mesh(12, halves[1])
+
+    with DracoPy.ShardReader(path) as shard:
+        assert len(shard) == 3
+        assert list(shard.ids) == [ 3, 7, 12 ]
+        assert 7 in shard and 4 not in shard
+        assert np.allclose(shard.bbox(3), np.concatenate([ halves[0].min(axis=0), halves[0].max(axis=0) ]))
+        assert np.array_equal(shard.decode(7).faces, DracoPy.decode(DracoPy.encode(points, faces)).faces)
+
+        decoded = shard.decode_many([ 12, 3 ], threads=2)
+        assert [ len(obj.points) for obj in decoded ] == [ len(halves[1]), len(halves[0]) ]
+        corner = points[np.argmin(points[:,0])]
+        assert 7 in shard.intersecting(corner, corner)
+        with pytest.raises(KeyError):
+            shard.decode(4)
+
+    with DracoPy.ShardReader(path) as shard:
+        bbox = shard.bbox(7)
+    assert np.allclose(bbox, np.concatenate([ points.min(axis=0), points.max(axis=0) ]))
+
+    duplicate = str(tmp_path / "duplicate.shard")
+    with DracoPy.ShardWriter(duplicate) as shard:
+        shard.add_mesh(1, halves[0])
+        with pytest.raises(ValueError):
+            shard.add_mesh(1, halves[1])
+    with DracoPy.ShardReader(duplicate) as shard:
+        assert list(shard.ids) == [ 1 ]
+        assert len(shard.decode(1).points) == len(halves[0])
+    with pytest.raises(DracoPy.FileTypeException):
+        DracoPy.ShardReader(os.path.join(testdata_directory, "bunny.drc"))
+
+
+def test_lazy_attributes():
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        binary = draco_file.read()
+    eager = DracoPy.decode(binary, stats={})
+    mesh = DracoPy.decode(binary)
+
+    position = mesh.get_attribute_by_type(DracoPy.AttributeType.POSITION)
+    assert dict.__getitem__(position, "data") is None
+    assert position["num_components"] == 3
+    assert dict.__getitem__(position, "data") is None
+
+    assert mesh.points is mesh.points
+    assert mesh.faces is mesh.faces
+    assert np.array_equal(mesh.points, eager.points)
+    assert np.array_equal(mesh.faces, eager.faces)
+    assert dict(position)["data"] is mesh.points
+    assert { **position }["data"] is mesh.points
+    assert position == eager.attributes[0]
+
+
+def test_lazy_attributes_from_threads():
+    from concurrent.futures import ThreadPoolExecutor
+
+    rng = np.random.default_rng(0)
+    num_points = 100000
+    binary = DracoPy.encode(
+        rng.random((num_points, 3), dtype=np.float32), rng.integers(0, num_points, (200000, 3), dtype=np.uint32),
+        normals=rng.random((num_points, 3), dtype=np.float32),
+        colors=rng.integers(0, 255, (num_points, 3), dtype=np.uint8),
+        generic_attributes={ "weights": rng.random((num_points, 4), dtype=np.float32) },
+    )
+    eager = DracoPy.decode(binary, threads=2)
+
+    for _ in range(10):
+        mesh = DracoPy.decode(binary)
+
+        def read(offset):
+            keys = [ "faces" ] + list(range(len(mesh.attributes)))
+            keys = keys[offset % len(keys):] + keys[:offset % len(keys)]
+            return { key: mesh.faces if key == "faces" else mesh.attributes[key]["data"] for key in keys }
+
+        with ThreadPoolExecutor(8) as pool:
+            results = list(pool.map(read, range(16)))
+        for result in results:
+            assert np.array_equal(result["faces"], eager.faces)
+            for i, attribute in enumerate(eager.attributes):
+                assert np.array_equal(result[i], attribute["data"])
+
+
+def test_stats_and_counters():
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        mesh = DracoPy.decode(draco_file.read())
+
+    encode_stats = {}
+    binary = DracoPy.encode(mesh.points, mesh.faces, stats=encode_stats)
+    assert binary == DracoPy.encode(mesh.points, mesh.faces)
+    assert set(encode_stats) == {
+        "marshal", "build", "draco", "copy",
+        "uncompressed_bytes", "compressed_bytes", "native_bytes", "allocated_bytes",
+        "welded_vertices",
+    }
+    assert encode_stats["draco"] > 0
+    assert encode_stats["uncompressed_bytes"] == mesh.points.nbytes + mesh.faces.nbytes
+    assert encode_stats["compressed_bytes"] == len(binary)
+
+    decode_stats = {}
+    decoded = DracoPy.decode(binary, stats=decode_stats)
+    assert set(decode_stats) == {
+        "header", "draco", "describe", "faces", "attributes", "wrap",
+        "uncompressed_bytes", "compressed_bytes", "native_bytes", "allocated_bytes",
+    }
+    assert decode_stats["compressed_bytes"] == len(binary)
+    assert decode_stats["uncompressed_bytes"] == decoded.points.nbytes + decoded.faces.nbytes
+    assert decode_stats["native_bytes"] > 0
+
+    DracoPy.enable_counters()
+    try:
+        DracoPy.reset_counters()
+        DracoPy.decode_many([ binary, binary ], threads=2)
+        DracoPy.Decoder().decode(binary)
+        DracoPy.encode_many([ (mesh.points, mesh.faces) ])
+        totals = DracoPy.counters()
+        assert totals["decode"]["calls"] == 3
+        assert totals["decode"]["compressed_bytes"] == 3 * len(binary)
+        assert totals["encode"]["calls"] == 1
+        assert totals["encode"]["compressed_bytes"] == len(binary)
+        DracoPy.reset_counters()
+        assert DracoPy.counters() == { "encode": {}, "decode": {} }
+    finally:
+        DracoPy.enable_counters(False)
+    DracoPy.decode(binary)
+    assert DracoPy.counters() == { "encode": {}, "decode": {} }
+
+
+def test_encode_weld():
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        mesh = DracoPy.decode(draco_file.read())
+    # a triangle soup, as marching cubes would write it
+    points = mesh.points[mesh.faces.reshape(-1)]
+    faces = np.arange(len(points), dtype=np.uint32).reshape((-1, 3))
+
+    unique_points = len(np.unique(points, axis=0))
+
+    stats = {}
+    decoded = DracoPy.decode(DracoPy.encode(points, faces, weld="exact", stats=stats))
+    assert stats["welded_vertices"] == len(points) - unique_points
+    assert len(decoded.points) == unique_points
+    expected = DracoPy.decode(DracoPy.encode(points, faces))
+    assert np.allclose(np.sort(decoded.points, axis=0), np.sort(expected.points, axis=0))
+
+    stats = {}
+    DracoPy.decode(DracoPy.encode(points, faces, weld="quantized", stats=stats))
+    assert stats["welded_vertices"] >= len(points) - unique_points
+
+    # vertices one grid cell apart stay apart, vertices closer than a cell merge
+    cell = 1.0 / (2**8 - 1)
+    points = np.array([ [0, 0, 0], [1, 1, 1], [cell, 0, 0], [cell * 1.1, 0, 0], [0, 0, 1] ], dtype=np.float32)
+    faces = np.array([ [0, 2, 4], [1, 3, 4] ], dtype=np.uint32)
+    stats = {}
+    DracoPy.encode(points, faces, quantization_bits=8, weld="quantized", stats=stats)
+    assert stats["welded_vertices"] == 1
+
+    with pytest.raises(ValueError):
+        DracoPy.encode(points, faces, weld="fast")
+
+
+def test_attribute_options():
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        mesh = DracoPy.decode(draco_file.read())
+    rng = np.random.default_rng(0)
+    curvature = rng.random((len(mesh.points), 1), dtype=np.float32)
+    generic_attributes = { "curvature": curvature }
+
+    lossless = DracoPy.encode(mesh.points, mesh.faces, generic_attributes=generic_attributes)
+    quantized = DracoPy.encode(
+        mesh.points, mesh.faces, generic_attributes=generic_attributes,
+        attribute_options={
+            "curvature": { "quantization_bits": 8, "prediction_scheme": DracoPy.PredictionScheme.DIFFERENCE },
+        },
+    )
+    assert len(quantized) < len(lossless)
+
+    decoded = DracoPy.decode(quantized)
+    attribute = decoded.get_attribute_by_name("curvature")
+    assert attribute["encoding_options"] == {
+        "quantization_bits": 8, "prediction_scheme": DracoPy.PredictionScheme.DIFFERENCE,
+    }
+    assert np.abs(attribute["data"].reshape(-1) - curvature.reshape(-1)).max() <= 1.0 / (2**8 - 1)
+    assert DracoPy.decode(lossless).get_attribute_by_name("curvature")["encoding_options"] is None
+
+    # an explicit grid, and position options standing in for quantization_bits
+    decoded = DracoPy.decode(DracoPy.encode(
+        mesh.points, mesh.faces, generic_attributes=generic_attributes,
+        attribute_options={
+            DracoPy.AttributeType.POSITION: { "quantization_bits": 10 },
+            "curvature": { "quantization_bits": 4, "quantization_origin": [0], "quantization_range": 2 },
+        },
+    ))
+    assert decoded.encoding_options.quantization_bits == 10
+    assert decoded.get_attribute_by_name("curvature")["encoding_options"] == {
+        "quantization_bits": 4, "quantization_range": 2.0, "quantization_origin": [0.0],
+    }
+
+    with pytest.raises(ValueError):
+        DracoPy.encode(mesh.points, mesh.faces, attribute_options={ "missing": { "quantization_bits": 8 } })
+    with pytest.raises(ValueError):
+        DracoPy.encode(mesh.points, mesh.faces, generic_attributes=generic_attributes,
+            attribute_options={ "curvature": { "bits": 8 } })
+
+def test_point_order():
+    rng = np.random.default_rng(0)
+    points = rng.random((20000, 3), dtype=np.float32)
+
+    def volume(bounds):
+        return np.prod(bounds[:, 3:] - bounds[:, :3], axis=1).sum()
+
+    shuffled = DracoPy.decode(DracoPy.encode(points, preserve_order=True))
+    assert shuffled.point_order is None
+    assert shuffled.point_permutation is None
+
+    for point_order in ("morton", "hilbert"):
+        decoded = DracoPy.decode(DracoPy.encode(
+            points, quantization_bits=16, point_order=point_order, store_permutation=True
+        ))
+        assert decoded.point_order == point_order
+        permutation = decoded.point_permutation
+        assert np.array_equal(np.sort(permutation), np.arange(len(points)))
+        assert np.allclose(decoded.points, points[permutation], atol=1e-4)
+        bounds = decoded.block_bounds(1024)
+        assert bounds.shape == (20, 6)
+        assert volume(bounds) < volume(shuffled.block_bounds(1024)) / 4
+
+    # kd-tree encoding keeps its own order; the permutation still maps it back
+    binary = DracoPy.encode(points, quantization_bits=16, encoding_method="kd_tree", store_permutation=True)
+    assert DracoPy.probe(binary)["encoding_method"] == 1
+    decoded = DracoPy.decode(binary)
+    assert np.allclose(decoded.points, points[decoded.point_permutation], atol=1e-4)
+
+    # options for every generic attribute do not apply to the permutation
+    weights = rng.random((len(points), 2), dtype=np.float32)
+    decoded = DracoPy.decode(DracoPy.encode(
+        points, point_order="morton", store_permutation=True, generic_attributes={ "weights": weights },
+        attribute_options={ DracoPy.AttributeType.GENERIC: { "quantization_bits": 12 } },
+    ))
+    permutation = decoded.point_permutation
+    assert np.array_equal(np.sort(permutation), np.arange(len(points)))
+    assert np.allclose(decoded.get_attribute_by_name("weights")["data"], weights[permutation], atol=1e-3)
+    assert decoded.get_attribute_by_name("weights")["encoding_options"]["quantization_bits"] == 12
+
+    with pytest.raises(ValueError):
+        DracoPy.encode(points, point_order="hilbert", encoding_method="kd_tree")
+    with pytest.raises(ValueError):
+        DracoPy.encode(points, np.array([[0, 1, 2]], dtype=np.uint32), point_order="morton")
+    with pytest.raises(ValueError):
+        DracoPy.encode(points, point_order="peano")
+
+def test_decode_bbox():
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        binary = draco_file.read()
+    full = DracoPy.decode(binary)
+    lo, hi = np.percentile(full.points, 25, axis=0), np.percentile(full.points, 75, axis=0)
+    bbox = np.concatenate([ lo, hi ])
+
+    inside = np.all((full.points >= lo) & (full.points <= hi), axis=1)
+    remap = np.cumsum(inside) - 1
+    kept_faces = full.faces[np.all(inside[full.faces], axis=1)]
+
+    for cropped in (DracoPy.decode(binary, bbox=bbox), DracoPy.decode(binary, bbox=bbox, stats={}),
+                    DracoPy.Decoder().decode(binary, bbox=bbox.reshape(2, 3))):
+        assert np.array_equal(cropped.points, full.points[inside])
+        assert np.array_equal(cropped.faces, remap[kept_faces])
+
+    # positions are cropped even when they are not returned
+    cropped = DracoPy.decode(binary, attributes=[], bbox=bbox)
+    assert len(cropped.faces) == len(kept_faces)
+
+    cloud = DracoPy.encode(full.points, preserve_order=True)
+    points = DracoPy.decode(cloud).points
+    cropped = DracoPy.decode(cloud, bbox=bbox)
+    assert np.array_equal(cropped.points, points[np.all((points >= lo) & (points <= hi), axis=1)])
+
+    # positions are dequantized for the crop even when not selected
+    rng = np.random.default_rng(0)
+    points = rng.random((1000, 3), dtype=np.float32) * 100
+    normals = rng.random((1000, 3), dtype=np.float32)
+    with_normals = DracoPy.encode(points, rng.integers(0, 1000, (2000, 3), dtype=np.uint32), normals=normals)
+    full = DracoPy.decode(with_normals)
+    box = [ 10, 10, 10, 60, 60, 60 ]
+    inside = np.all((full.points >= 10) & (full.points <= 60), axis=1)
+    decoder = DracoPy.Decoder(attributes=[ DracoPy.AttributeType.NORMAL ])
+    for cropped in (DracoPy.decode(with_normals, attributes=[ DracoPy.AttributeType.NORMAL ], bbox=box),
+                    decoder.decode(with_normals, bbox=box)):
+        assert np.array_equal(cropped.normals, full.normals[inside])
+    assert len(decoder.decode(with_normals).normals) == len(full.points)
+
+    # a crop without faces is still a mesh
+    empty = DracoPy.decode(with_normals, bbox=[ 200, 200, 200, 300, 300, 300 ])
+    assert type(empty) is DracoPy.DracoMesh
+    assert empty.faces.shape == (0, 3)
+
+    with pytest.raises(ValueError):
+        DracoPy.decode(binary, bbox=[ 0, 0, 0 ])
+    with pytest.raises(ValueError):
+        DracoPy.decode(binary, bbox=np.concatenate([ hi, lo ]))
+
+def test_decode_threads():
+    rng = np.random.default_rng(0)
+    num_points = 200000
+    points = rng.random((num_points, 3), dtype=np.float32)
+    faces = rng.integers(0, num_points, (300000, 3), dtype=np.uint32)
+    generic_attributes = {
+        "label": rng.integers(0, 100, (num_points, 1), dtype=np.uint16),
+        "weights": rng.random((num_points, 4), dtype=np.float32),
+    }
+    binary = DracoPy.encode(
+        points, faces, colors=rng.integers(0, 255, (num_points, 3), dtype=np.uint8),
+        normals=rng.random((num_points, 3), dtype=np.float32),
+        generic_attributes=generic_attributes, preserve_order=True,
+    )
+
+    expected = DracoPy.decode(binary)
+    for decoded in (DracoPy.decode(binary, threads=4), DracoPy.decode(binary, threads=0, stats={}),
+                    DracoPy.Decoder(threads=3).decode(binary)):
+        assert np.array_equal(decoded.faces, expected.faces)
+        assert len(decoded.attributes) == len(expected.attributes)
+        for attribute, expected_attribute in zip(decoded.attributes, expected.attributes):
+            assert np.array_equal(attribute["data"], expected_attribute["data"])
+
+    bbox = [ 0.2, 0.2, 0.2, 0.7, 0.7, 0.7 ]
+    cropped = DracoPy.decode(binary, bbox=bbox)
+    decoded = DracoPy.decode(binary, bbox=bbox, threads=4)
+    assert np.array_equal(decoded.points, cropped.points)
+    assert np.array_equal(decoded.get_attribute_by_name("weights")["data"], cropped.get_attribute_by_name("weights")["data"])
+
+def test_decode_limits():
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        binary = draco_file.read()
+    expected = DracoPy.decode(binary)
+    num_points, num_faces = len(expected.points), len(expected.faces)
+
+    generous = { "max_points": num_points, "max_faces": num_faces, "max_attributes": len(expected.attributes), "max_output_bytes": 1 << 30 }
+    for decoded in (DracoPy.decode(binary, limits=generous), DracoPy.Decoder(limits=generous).decode(binary)):
+        assert np.array_equal(decoded.points, expected.points)
+        assert np.array_equal(decoded.faces, expected.faces)
+
+    for limits in ({ "max_points": num_points - 1 }, { "max_faces": num_faces - 1 },
+                   { "max_output_bytes": num_faces * 12 }):
+        with pytest.raises(DracoPy.DecodeLimitException):
+            DracoPy.decode(binary, limits=limits)
+        with pytest.raises(DracoPy.DecodeLimitException):
+            DracoPy.decode_many([ binary ], limits=limits)
+
+    cloud = DracoPy.encode(expected.points, generic_attributes={ "id": np.arange(num_points, dtype=np.uint32) })
+    with pytest.raises(DracoPy.DecodeLimitException):
+        DracoPy.decode(cloud, limits={ "max_attributes": 1 })
+    with pytest.raises(DracoPy.DecodeLimitException):
+        DracoPy.decode(cloud, limits={ "max_points": 100 })
+
+    # truncated input is a decoding failure, not a file type error
+    with pytest.raises(TypeError):
+        DracoPy.decode(binary[:len(binary) // 2], limits=generous)
+    with pytest.raises(TypeError):
+        DracoPy.decode(binary[:len(binary) // 2])
+    with pytest.raises(DracoPy.FileTypeException):
+        DracoPy.decode(b"not a draco file", limits=generous)
+
+    with pytest.raises(ValueError):
+        DracoPy.decode(binary, limits={ "max_vertices": 10 })
+    with pytest.raises(ValueError):
+        DracoPy.decode(binary, limits={ "max_points": 0 })
+
+def test_encode_auto():
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        mesh = DracoPy.decode(draco_file.read())
+    points, faces = mesh.points.astype(np.float64), mesh.faces
+
+    binary, report = DracoPy.encode_auto(points, faces, max_error=1e-3, sample_size=20000)
+    assert report["met"]
+    assert report["max_error"] <= 1e-3
+    assert 0 < report["rms_error"] <= report["max_error"]
+    assert report["encoded_bytes"] == len(binary)
+    assert len(report["trials"]) == 11
+    decoded = DracoPy.decode(binary)
+    assert len(decoded.faces) == len(faces)
+
+    # with the whole mesh as the sample, size estimates are exact
+    budget = len(DracoPy.encode(points, faces, quantization_bits=12, compression_level=7))
+    binary, report = DracoPy.encode_auto(points, faces, max_bytes=budget, sample_size=len(faces))
+    assert report["met"]
+    assert len(binary) <= budget
+    assert report["quantization_bits"] >= 12
+
+    # errors are measured on the decoded bytes, also when points are reordered
+    for options in ({ "point_order": "hilbert" }, { "preserve_order": True }):
+        binary, report = DracoPy.encode_auto(points, max_error=1e-3, **options)
+        assert report["met"]
+        decoded = DracoPy.decode(binary).points
+        nearest = [ np.min(np.linalg.norm(decoded - point, axis=1)) for point in points[:100] ]
+        assert max(nearest) <= report["max_error"] <= 1e-3
+
+    with pytest.raises(ValueError):
+        DracoPy.encode_auto(points, faces, quantization_bits=11)
+
+
+def test_encode_partitioned():
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        mesh = DracoPy.decode(draco_file.read())
+    points, faces = mesh.points, mesh.faces
+
+    buffers, manifest = DracoPy.encode_partitioned(
+        points, faces, grid=(2, 2, 1), threads=2, vertex_ids=True, preserve_order=True
+    )
+    assert len(buffers) == len(manifest["cells"]) > 1
+    assert sum(cell["num_faces"] for cell in manifest["cells"]) == len(faces)
+    assert all(0 <= x < 2 and 0 <= y < 2 and z == 0 for x, y, z in (cell["cell"] for cell in manifest["cells"]))
+
+    # seams quantize identically, so the cells stitch back into the original mesh
+    whole = DracoPy.decode(DracoPy.encode(
+        points, faces, preserve_order=True,
+        quantization_origin=manifest["quantization_origin"],
+        quantization_range=manifest["quantization_range"],
+    ))
+    stitched = DracoPy.decode_chunks(buffers)
+    assert np.array_equal(stitched.points, whole.points)
+    assert len(stitched.faces) == len(faces)
+
+    with pytest.raises(ValueError):
+        DracoPy.encode_partitioned(points, faces, grid=(2, 0, 1))
+
+
+def test_stream_encoder():
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        mesh = DracoPy.decode(draco_file.read())
+    points, faces = mesh.points, mesh.faces
+    labels = np.arange(len(points), dtype=np.uint16).reshape((-1, 1))
+
+    encoder = DracoPy.StreamEncoder(chunk_faces=20000, preserve_order=True)
+    for start in range(0, len(points), 10000):
+        encoder.add_vertices(
+            points[start:start + 10000],
+            generic_attributes={ "labels": labels[start:start + 10000] },
+        )
+    chunks = []
+    for start in range(0, len(faces), 7000):
+        chunks += encoder.add_faces(faces[start:start + 7000])
+    chunks += encoder.finish()
+    assert len(chunks) == int(np.ceil(len(faces) / 20000))
+
+    with pytest.raises(ValueError):
+        encoder.add_vertices(points.max(axis=0, keepdims=True) + 1)
+
+    decoded = DracoPy.decode_chunks(chunks, threads=2)
+    assert np.array_equal(decoded.faces, faces)
+    assert np.array_equal(decoded.get_attribute_by_name("labels")["data"], labels)
+    assert decoded.get_attribute_by_name(DracoPy.STREAM_VERTEX_ID) is None
+    step = encoder.quantization_range / (2 ** 14 - 1)
+    assert np.allclose(decoded.points, points, atol=step)
+
+    lazy = list(DracoPy.decode_chunks(chunks, lazy=True))
+    assert len(lazy) == len(chunks)
+    for chunk in lazy:
+        ids = chunk.get_attribute_by_name(DracoPy.STREAM_VERTEX_ID)["data"][:,0]
+        assert np.array_equal(decoded.points[ids], chunk.points)
+
+
+def test_decode_empty_chunks(monkeypatch):
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        mesh = DracoPy.decode(draco_file.read())
+    encoder = DracoPy.StreamEncoder(chunk_faces=20000)
+    encoder.add_vertices(mesh.points)
+    chunks = encoder.add_faces(mesh.faces) + encoder.finish()
+
+    # chunks cropped to nothing keep their attributes but no vertices
+    far = mesh.points.max(axis=0) + 1
+    decode_many = DracoPy.decode_many
+    monkeypatch.setattr(DracoPy, "decode_many", lambda buffers, threads=0: decode_many(
+        buffers, threads, bbox=np.concatenate([ far, far + 1 ])
+    ))
+    empty = DracoPy.decode_chunks(chunks)
+    assert type(empty) is DracoPy.DracoMesh
+    assert empty.points.shape == (0, 3)
+    assert empty.faces.shape == (0, 3)
+
+
+@pytest.mark.parametrize("dtype", [
+    np.int8, np.uint8, np.int16, np.uint16,
+    np.int32, np.uint32, np.int64, np.uint64,
+])
+@pytest.mark.parametrize("faces", [True, False])
+def test_generic_attributes_keep_native_width(dtype, faces):
+    with open(os.path.join(testdata_directory, "bunny.drc"), 'rb') as draco_file:
+        mesh = DracoPy.decode(draco_file.read())
+
+    info = np.iinfo(dtype)
+    labels = np.linspace(info.min // 2, info.max // 2, num=mesh.points.shape[0] * 2)
+    labels = labels.astype(dtype).reshape((-1, 2))
+
+    binary = DracoPy.encode(
+        mesh.points, mesh.faces if faces else None,
+        preserve_order=True,
+        generic_attributes={ "labels": labels },
+    )
+    decoded = DracoPy.decode(binary)
+    attr = decoded.get_attribute_by_name("labels")
+
+    assert attr["data_type"] == DracoPy.DATA_TYPES[np.dtype(dtype)]
+    assert attr["data"].dtype == dtype
+    assert np.array_equal(attr["data"], labels)
+
+
+def test_encode_borrows_native_dtypes():
+    with open(os.path.join(testdata_directory, "bunny.drc"), "rb") as draco_file:
+        mesh = DracoPy.decode(draco_file.read())
+
+    reference = DracoPy.encode(mesh.points, mesh.faces)
+
+    assert reference == DracoPy.encode(mesh.points.astype(np.float64), mesh.faces.astype(np.int64))
+    assert reference == DracoPy.encode(np.asfortranarray(mesh.points), np.asfortranarray(mesh.faces))
+
+    normals = np.tile(np.array([[0.0, 0.0, 1.0]]), (mesh.points.shape[0], 1))
+    assert (
+        DracoPy.encode(mesh.points, mesh.faces, normals=normals)
+        == DracoPy.encode(mesh.points, mesh.faces, normals=normals.astype(np.float32))
+    )